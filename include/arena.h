@@ -0,0 +1,89 @@
+// arena allocation
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// bump allocator released all at once; nothing allocated here is destroyed
+
+class Arena {
+  struct Chunk {
+    Chunk *Next;
+    size_t Size;
+  };
+
+  Chunk *Chunks;
+  char *Cur;
+  char *End;
+  size_t BytesAllocated;
+
+  void addChunk(size_t minimum);
+
+public:
+  Arena() : Chunks(0), Cur(0), End(0), BytesAllocated(0) {}
+  ~Arena();
+
+  void *Allocate(size_t size, size_t align);
+  void Release();
+
+  // how far allocation has reached, to rewind to when what follows turns
+  // out not to be needed
+  struct Mark {
+    Chunk *Chunks;
+    char *Cur;
+    size_t BytesAllocated;
+  };
+
+  Mark getMark() const {
+    Mark mark = { Chunks, Cur, BytesAllocated };
+    return mark;
+  }
+
+  void Rewind(const Mark &mark);
+
+  size_t getBytesAllocated() const { return BytesAllocated; }
+};
+
+// AST nodes are allocated from whichever arena is current
+
+void SetASTArena(Arena *arena);
+Arena *GetASTArena();
+
+inline void *AllocateAST(size_t size, size_t align = alignof(double)) {
+  return GetASTArena()->Allocate(size, align);
+}
+
+class ArenaNode {
+public:
+  static void *operator new(size_t size) { return AllocateAST(size); }
+  static void operator delete(void *) {}
+};
+
+// fixed-size array copied into the current AST arena
+
+template <typename T>
+class ArenaArray {
+  T *Items;
+  unsigned Count;
+
+public:
+  ArenaArray() : Items(0), Count(0) {}
+  ArenaArray(const std::vector<T> &items)
+    : Items(0), Count(items.size()) {
+    if (Count) {
+      Items = (T *)AllocateAST(Count * sizeof(T), alignof(T));
+      for (unsigned i = 0; i < Count; i++) new (&Items[i]) T(items[i]);
+    }
+  }
+
+  unsigned size() const { return Count; }
+  T &operator[](unsigned i) const { return Items[i]; }
+
+  T *begin() const { return Items; }
+  T *end() const { return Items + Count; }
+};
+
+#endif
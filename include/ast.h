@@ -9,21 +9,68 @@
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Module.h"
 
+#include "arena.h"
 #include "lexer.h"
 #include "types.h"
 
 using namespace llvm;
 
-class ExprAST {
+class Scope;
+struct ConstantBinding;
+struct FunctionBinding;
+struct TailCalls;
+struct EvalValue;
+class CallExprAST;
+
+// nodes are allocated in the current AST arena and released in bulk
+
+class ExprAST : public ArenaNode {
   SourceLocation Location;
+  TypeData *InferredType;
+
+protected:
+  virtual TypeData *InferType() = 0;
 
 public:
   virtual ~ExprAST() {}
   virtual Value *Codegen() = 0;
-  virtual TypeData *Typecheck() = 0;
+  virtual bool Resolve(Scope *scope) = 0;
+
+  // an unresolved copy, for instantiating generic functions, see generic
+  virtual ExprAST *Clone() const = 0;
+
+  // marks the calls in tail position and counts those that call self
+  virtual void MarkTailPosition(TailCalls *calls) {}
+
+  // this expression as a call to the function, if it is one
+  virtual CallExprAST *getCallTo(FunctionBinding *function) { return 0; }
+
+  // conservative, anything that calls out may have effects
+  virtual bool MayHaveEffects() const { return true; }
+
+  // what evaluating this may do, given what is known of the functions called
+  virtual Effect getEffect() const { return effect_any; }
+
+  // the value computed at compile time, false if it can't be, see evaluate
+  virtual bool Evaluate(EvalValue &result) { return false; }
+
+  // folds constant subexpressions, returning what replaces this one
+  virtual ExprAST *Fold() { return this; }
+
+  // a literal, possibly an aggregate of literals, or a constant's name
+  virtual bool isLiteral() const { return false; }
 
   ExprAST(SourceLocation loc)
-    : Location(loc) {}
+    : Location(loc), InferredType(0) {}
+
+  // infers the type once and annotates the node with it
+  TypeData *Typecheck() {
+    if (!InferredType) InferredType = InferType();
+    return InferredType;
+  }
+
+  // the annotated type, only valid once the node has been typechecked
+  TypeData *getType() const { return InferredType; }
 
   SourceLocation getLocation() const { return Location; }
 };
@@ -34,16 +81,30 @@ public:
   BooleanExprAST(SourceLocation loc, bool val)
     : ExprAST(loc), Val(val) {}
   virtual Value *Codegen();
-  virtual TypeData *Typecheck();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual bool MayHaveEffects() const { return false; }
+  virtual Effect getEffect() const { return effect_none; }
+  virtual bool Evaluate(EvalValue &result);
+  virtual bool isLiteral() const { return true; }
+protected:
+  virtual TypeData *InferType();
 };
 
 class IntegerExprAST : public ExprAST {
-  int Val;
+  int64_t Val;
 public:
-  IntegerExprAST(SourceLocation loc, int val)
+  IntegerExprAST(SourceLocation loc, int64_t val)
     : ExprAST(loc), Val(val) {}
   virtual Value *Codegen();
-  virtual TypeData *Typecheck();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual bool MayHaveEffects() const { return false; }
+  virtual Effect getEffect() const { return effect_none; }
+  virtual bool Evaluate(EvalValue &result);
+  virtual bool isLiteral() const { return true; }
+protected:
+  virtual TypeData *InferType();
 };
 
 class NumberExprAST : public ExprAST {
@@ -52,45 +113,115 @@ public:
   NumberExprAST(SourceLocation loc, double val)
     : ExprAST(loc), Val(val) {}
   virtual Value *Codegen();
-  virtual TypeData *Typecheck();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual bool MayHaveEffects() const { return false; }
+  virtual Effect getEffect() const { return effect_none; }
+  virtual bool Evaluate(EvalValue &result);
+  virtual bool isLiteral() const { return true; }
+protected:
+  virtual TypeData *InferType();
 };
 
+// a local slot, or else a top-level constant
 class VariableExprAST : public ExprAST {
-  std::string Name;
+  Symbol Name;
+  unsigned Slot;
+  ConstantBinding *Binding;
+
+  // a function named as a value rather than called
+  FunctionBinding *FunctionRef;
 public:
-  VariableExprAST(SourceLocation loc, const std::string &name)
-    : ExprAST(loc), Name(name) {}
+  VariableExprAST(SourceLocation loc, Symbol name)
+    : ExprAST(loc), Name(name), Slot(0), Binding(0), FunctionRef(0) {}
   virtual Value *Codegen();
-  virtual TypeData *Typecheck();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual bool MayHaveEffects() const { return false; }
+  virtual Effect getEffect() const;
+  virtual bool Evaluate(EvalValue &result);
+  virtual ExprAST *Fold();
+  virtual bool isLiteral() const;
+protected:
+  virtual TypeData *InferType();
 };
 
 class BinaryExprAST : public ExprAST {
   char Op;
   ExprAST *LHS, *RHS;
+
+  // 'x op f(...)' in tail position of f, with the operand x
+  CallExprAST *SelfCall;
+  ExprAST *Operand;
 public:
   BinaryExprAST(SourceLocation loc, char op, ExprAST *lhs, ExprAST *rhs)
-    : ExprAST(loc), Op(op), LHS(lhs), RHS(rhs) {}
+    : ExprAST(loc), Op(op), LHS(lhs), RHS(rhs), SelfCall(0), Operand(0) {}
   virtual Value *Codegen();
-  virtual TypeData *Typecheck();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual bool MayHaveEffects() const;
+  virtual Effect getEffect() const;
+  virtual void MarkTailPosition(TailCalls *calls);
+  virtual bool Evaluate(EvalValue &result);
+  virtual ExprAST *Fold();
+protected:
+  virtual TypeData *InferType();
 };
 
 class CallExprAST : public ExprAST {
-  std::string Callee;
-  std::vector<ExprAST*> Args;
+  Symbol Callee;
+  ArenaArray<ExprAST*> Args;
+  FunctionBinding *Binding;
+  bool Tail;
+  bool RequireTail;
+
+  // an argument or local holding a function, called through its pointer
+  bool Indirect;
+  unsigned Slot;
+
+  bool isCast() const {
+    return Callee == sym_integer || Callee == sym_number || Callee == sym_boolean;
+  }
+
+  // length(a) counts the elements of any array or slice
+  bool isLength() const { return Callee == sym_length; }
+  bool isBuiltin() const { return isCast() || isLength(); }
 public:
-  CallExprAST(SourceLocation loc, const std::string &callee, const std::vector<ExprAST*> &args)
-    : ExprAST(loc), Callee(callee), Args(args) {}
+  CallExprAST(SourceLocation loc, Symbol callee, const std::vector<ExprAST*> &args)
+    : ExprAST(loc), Callee(callee), Args(args), Binding(0), Tail(false), RequireTail(false), Indirect(false), Slot(0) {}
   virtual Value *Codegen();
-  virtual TypeData *Typecheck();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual void MarkTailPosition(TailCalls *calls);
+  virtual CallExprAST *getCallTo(FunctionBinding *function);
+  virtual bool MayHaveEffects() const;
+  virtual Effect getEffect() const;
+  virtual bool Evaluate(EvalValue &result);
+  virtual ExprAST *Fold();
+
+  // written as 'tail f(x)', an error unless it compiles to a tail call
+  void requireTail() { RequireTail = true; }
+
+  // a self call folding its operand into the accumulator, see BinaryExprAST
+  Value *CodegenAccumulated(char op, Value *operand, ExprAST *expression);
+protected:
+  virtual TypeData *InferType();
 };
 
 class ArrayLiteralExprAST : public ExprAST {
-  std::vector<ExprAST *> Elements;
+  ArenaArray<ExprAST *> Elements;
 public:
   ArrayLiteralExprAST(SourceLocation loc, std::vector<ExprAST *> &elements)
     : ExprAST(loc), Elements(elements) {}
   virtual Value *Codegen();
-  virtual TypeData *Typecheck();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual Effect getEffect() const;
+  virtual bool Evaluate(EvalValue &result);
+  virtual ExprAST *Fold();
+  virtual bool isLiteral() const;
+protected:
+  virtual TypeData *InferType();
 };
 
 class ArrayReferenceExprAST : public ExprAST {
@@ -100,36 +231,115 @@ public:
   ArrayReferenceExprAST(SourceLocation loc, ExprAST *source, ExprAST *index)
     : ExprAST(loc), Source(source), Index(index) {};
   virtual Value *Codegen();
-  virtual TypeData *Typecheck();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual bool MayHaveEffects() const;
+  virtual Effect getEffect() const;
+  virtual bool Evaluate(EvalValue &result);
+  virtual ExprAST *Fold();
+protected:
+  virtual TypeData *InferType();
+};
+
+// a[start..end] views the elements start up to end without copying them
+class SliceExprAST : public ExprAST {
+  ExprAST *Source;
+  ExprAST *Start;
+  ExprAST *End;
+public:
+  SliceExprAST(SourceLocation loc, ExprAST *source, ExprAST *start, ExprAST *end)
+    : ExprAST(loc), Source(source), Start(start), End(end) {}
+  virtual Value *Codegen();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual bool MayHaveEffects() const;
+  virtual Effect getEffect() const;
+  virtual ExprAST *Fold();
+protected:
+  virtual TypeData *InferType();
+};
+
+// embed "path" is the contents of the file as a constant [byte]
+class EmbedExprAST : public ExprAST {
+  Symbol Path;
+public:
+  EmbedExprAST(SourceLocation loc, Symbol path)
+    : ExprAST(loc), Path(path) {}
+  virtual Value *Codegen();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual bool MayHaveEffects() const { return false; }
+  virtual Effect getEffect() const { return effect_none; }
+protected:
+  virtual TypeData *InferType();
 };
 
 class ValueLiteralAST : public ExprAST {
-  std::string ValueType;
-  std::vector<ExprAST*> Fields;
+  Symbol ValueType;
+  ArenaArray<ExprAST*> Fields;
 public:
-  ValueLiteralAST(SourceLocation loc, const std::string &type, const std::vector<ExprAST*> &fields)
+  ValueLiteralAST(SourceLocation loc, Symbol type, const std::vector<ExprAST*> &fields)
     : ExprAST(loc), ValueType(type), Fields(fields) {}
   virtual Value *Codegen();
-  virtual TypeData *Typecheck();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual Effect getEffect() const;
+  virtual bool Evaluate(EvalValue &result);
+  virtual ExprAST *Fold();
+  virtual bool isLiteral() const;
+protected:
+  virtual TypeData *InferType();
 };
 
 class ValueReferenceAST : public ExprAST {
   ExprAST *Source;
-  std::string FieldReference;
+  Symbol FieldReference;
 public:
-  ValueReferenceAST(SourceLocation loc, ExprAST *source, const std::string &ref)
+  ValueReferenceAST(SourceLocation loc, ExprAST *source, Symbol ref)
     : ExprAST(loc), Source(source), FieldReference(ref) {}
   virtual Value *Codegen();
-  virtual TypeData *Typecheck();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual bool MayHaveEffects() const;
+  virtual Effect getEffect() const;
+  virtual bool Evaluate(EvalValue &result);
+  virtual ExprAST *Fold();
+protected:
+  virtual TypeData *InferType();
 };
 
 class BlockExprAST : public ExprAST {
-  std::vector<ExprAST *> Statements;
+  ArenaArray<ExprAST *> Statements;
 public:
   BlockExprAST(SourceLocation loc, std::vector<ExprAST *> &statements)
     : ExprAST(loc), Statements(statements) {}
   virtual Value *Codegen();
-  virtual TypeData *Typecheck();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual Effect getEffect() const;
+  virtual void MarkTailPosition(TailCalls *calls);
+  virtual bool Evaluate(EvalValue &result);
+  virtual ExprAST *Fold();
+protected:
+  virtual TypeData *InferType();
+};
+
+// let name = value, a statement binding name for the rest of its block
+class LetExprAST : public ExprAST {
+  Symbol Name;
+  unsigned Slot;
+  ExprAST *Value;
+public:
+  LetExprAST(SourceLocation loc, Symbol name, ExprAST *value)
+    : ExprAST(loc), Name(name), Slot(0), Value(value) {}
+  virtual llvm::Value *Codegen();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual Effect getEffect() const;
+  virtual bool Evaluate(EvalValue &result);
+  virtual ExprAST *Fold();
+protected:
+  virtual TypeData *InferType();
 };
 
 class ConditionalExprAST : public ExprAST {
@@ -140,59 +350,172 @@ public:
   ConditionalExprAST(SourceLocation loc, ExprAST *cond, ExprAST *cons, ExprAST *alt)
     : ExprAST(loc), Condition(cond), Consequent(cons), Alternate(alt) {}
   virtual Value *Codegen();
-  virtual TypeData *Typecheck();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual bool MayHaveEffects() const;
+  virtual Effect getEffect() const;
+  virtual void MarkTailPosition(TailCalls *calls);
+  virtual bool Evaluate(EvalValue &result);
+  virtual ExprAST *Fold();
+protected:
+  virtual TypeData *InferType();
 };
 
-class ValueTypeAST {
+// loops are evaluated for their effects, their type is void
+
+class WhileExprAST : public ExprAST {
+  ExprAST *Condition;
+  ExprAST *Body;
+public:
+  WhileExprAST(SourceLocation loc, ExprAST *cond, ExprAST *body)
+    : ExprAST(loc), Condition(cond), Body(body) {}
+  virtual Value *Codegen();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual Effect getEffect() const;
+  virtual bool Evaluate(EvalValue &result);
+  virtual ExprAST *Fold();
+protected:
+  virtual TypeData *InferType();
+};
+
+// for i in start..end body, over the integers from start up to end
+class ForExprAST : public ExprAST {
+  Symbol Name;
+  unsigned Slot;
+  ExprAST *Start;
+  ExprAST *End;
+  ExprAST *Body;
+public:
+  ForExprAST(SourceLocation loc, Symbol name, ExprAST *start, ExprAST *end, ExprAST *body)
+    : ExprAST(loc), Name(name), Slot(0), Start(start), End(end), Body(body) {}
+  virtual Value *Codegen();
+  virtual bool Resolve(Scope *scope);
+  virtual ExprAST *Clone() const;
+  virtual Effect getEffect() const;
+  virtual bool Evaluate(EvalValue &result);
+  virtual ExprAST *Fold();
+protected:
+  virtual TypeData *InferType();
+};
+
+class ValueTypeAST : public ArenaNode {
   SourceLocation Location;
 
-  std::string Name;
-  std::vector<TypeSpecifier *> ElementTypes;
-  std::vector<std::string> ElementNames;
+  Symbol Name;
+  ArenaArray<TypeSpecifier *> ElementTypes;
+  ArenaArray<Symbol> ElementNames;
 public:
   ValueTypeAST(
     SourceLocation loc,
-    const std::string &name,
+    Symbol name,
     const std::vector<TypeSpecifier *> &eltypes,
-    const std::vector<std::string> &elnames
+    const std::vector<Symbol> &elnames
   ) : Location(loc), Name(name), ElementTypes(eltypes), ElementNames(elnames) {}
 
   TypeData *MakeType();
 };
 
-class PrototypeAST {
+class PrototypeAST : public ArenaNode {
   SourceLocation Location;
 
-  std::string Name;
+  Symbol Name;
   TypeSpecifier *Returns;
-  std::vector<TypeSpecifier *> ArgTypes;
-  std::vector<std::string> ArgNames;
+  ArenaArray<TypeSpecifier *> ArgTypes;
+  ArenaArray<Symbol> ArgNames;
+  FunctionBinding *Binding;
+  bool Pure;
+  ArenaArray<Symbol> TypeParams;
 public:
   PrototypeAST(
     SourceLocation loc,
-    const std::string &name,
+    Symbol name,
     TypeSpecifier *returns,
     const std::vector<TypeSpecifier *> &argtypes,
-    const std::vector<std::string> &argnames
+    const std::vector<Symbol> &argnames
   )
-    : Location(loc), Name(name), Returns(returns), ArgTypes(argtypes), ArgNames(argnames) {}
+    : Location(loc), Name(name), Returns(returns), ArgTypes(argtypes), ArgNames(argnames), Binding(0), Pure(false) {}
   Function *Codegen();
   FunctionTypeData *Typecheck();
+  bool Resolve(Scope *scope);
 
   void UpdateArguments(Function *F);
 
-  const std::string getName() { return Name; }
+  // an external declared pure computes its result from its arguments alone
+  void setPure() { Pure = true; }
+
+  // function <T, U> (...) is generic over T and U, see generic
+  void setTypeParameters(const std::vector<Symbol> &params) { TypeParams = ArenaArray<Symbol>(params); }
+  bool isGeneric() const { return TypeParams.size() > 0; }
+  bool Match(const std::vector<TypeData *> &argTypes, TypeParameters &params);
+  Symbol getInstanceName(const TypeParameters &params);
+  PrototypeAST *Instantiate(Symbol name, const TypeParameters &params);
+
+  Symbol getName() { return Name; }
+  FunctionBinding *getBinding() { return Binding; }
   const SourceLocation getLocation() { return Location; }
 };
 
-class FunctionAST {
+// constant name = value, at top level
+class ConstantAST : public ArenaNode {
+  SourceLocation Location;
+  Symbol Name;
+  ExprAST *Value;
+  ConstantBinding *Binding;
+  Function *Initializer;
+public:
+  ConstantAST(SourceLocation loc, Symbol name, ExprAST *value)
+    : Location(loc), Name(name), Value(value), Binding(0), Initializer(0) {}
+  bool Codegen();
+  TypeData *Typecheck();
+  bool Resolve();
+  void Fold();
+
+  // stores the value if it couldn't be folded, zero otherwise
+  Function *getInitializer() { return Initializer; }
+};
+
+// what a memo table does with a new result whose slot is already taken
+
+enum MemoEviction {
+  evict_replace,    // the newest result wins
+  evict_keep        // the first result stays
+};
+
+class FunctionAST : public ArenaNode {
   PrototypeAST *Proto;
   ExprAST *Body;
+  unsigned NumSlots;
+  bool SelfTailCalls;
+  char AccumulatorOp;
+  unsigned MemoCapacity;
+  MemoEviction Eviction;
 public:
   FunctionAST(PrototypeAST *proto, ExprAST *body)
-    : Proto(proto), Body(body) {}
+    : Proto(proto), Body(body), NumSlots(0), SelfTailCalls(false), AccumulatorOp(0),
+      MemoCapacity(0), Eviction(evict_replace) {}
   Function *Codegen();
   FunctionTypeData *Typecheck();
+  bool Resolve();
+
+  // caches results in a table of the given number of entries, see codegen
+  void setMemo(unsigned capacity, MemoEviction eviction) {
+    MemoCapacity = capacity;
+    Eviction = eviction;
+  }
+
+  // folds the body, then makes it available to compile-time evaluation
+  void Fold();
+  bool Evaluate(std::vector<EvalValue> &arguments, EvalValue &result);
+
+  // infers the effect of calling the function from its body, see resolve
+  Effect InferEffect();
+
+  // the instance called with these argument types, compiled on first use
+  bool isGeneric() const { return Proto->isGeneric(); }
+  FunctionBinding *Instantiate(const std::vector<TypeData *> &argTypes, SourceLocation loc);
+
+  PrototypeAST *getPrototype() { return Proto; }
 };
 
 #endif
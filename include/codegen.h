@@ -3,8 +3,14 @@
 #ifndef _CODEGEN_H
 #define _CODEGEN_H
 
-void InitializeCodegen(const char *filename);
+void InitializeCodegen(const char *filename, unsigned optLevel);
+void BeginIncrementalModule();
+void EnableBoundsChecks();
+void EnableSpecialization(unsigned budget, bool report);
+llvm::Module *GetCodegenModule();
 void CreateMainFunction(std::vector<ExprAST *> expressions);
+void FinalizeCode();
+void OptimizeCode(unsigned optLevel);
 void DumpAllCode();
 
 #endif
@@ -0,0 +1,23 @@
+// emit
+
+#ifndef _EMIT_H
+#define _EMIT_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CodeGen.h"
+
+enum OutputKind {
+  output_ir,
+  output_bitcode,
+  output_assembly,
+  output_object,
+};
+
+llvm::CodeGenOpt::Level getCodeGenOptLevel(unsigned optLevel);
+
+bool InitializeTarget(unsigned optLevel);
+void ConfigureModuleForTarget(llvm::Module *module);
+
+bool EmitToFile(llvm::Module *module, const char *filename, OutputKind kind);
+
+#endif
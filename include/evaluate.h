@@ -0,0 +1,26 @@
+// compile-time evaluation
+
+#ifndef _EVALUATE_H
+#define _EVALUATE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "types.h"
+
+// a value computed at compile time: booleans and integers are kept in
+// Integer, arrays and value types in Elements
+struct EvalValue {
+  TypeData *Type;
+  int64_t Integer;
+  double Number;
+  std::vector<EvalValue> Elements;
+
+  EvalValue() : Type(0), Integer(0), Number(0) {}
+};
+
+// in an interactive session a function can be redefined, so calls are
+// never replaced by what the current definition returns
+void InitializeEvaluator(bool redefinable);
+
+#endif
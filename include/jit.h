@@ -0,0 +1,27 @@
+// jit
+
+#ifndef _JIT_H
+#define _JIT_H
+
+#include <cstdint>
+
+#include "llvm/IR/Module.h"
+
+#include "resolve.h"
+
+// the generated main, see CreateMainFunction
+typedef int64_t (*MainFunction)();
+
+// compile the module in memory and find its main, externals are resolved
+// against the symbols of the running process
+MainFunction CompileForExecution(llvm::Module *module, unsigned optLevel);
+
+// An interactive session hands each item's module to the JIT, which
+// generates code for a module the first time something refers to it.
+
+bool InitializeSession(llvm::Module *module, unsigned optLevel);
+void AddToSession(llvm::Module *module);
+bool ReplaceInSession(FunctionBinding *binding, llvm::Function *F);
+void *GetSessionAddress(llvm::Function *F);
+
+#endif
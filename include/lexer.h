@@ -3,8 +3,11 @@
 #ifndef _LEXER_H
 #define _LEXER_H
 
+#include <cstdint>
 #include <string>
 
+#include "symbols.h"
+
 enum Token {
 
   // EOF
@@ -31,13 +34,34 @@ enum Token {
   // if and else
   tok_if = -12, tok_else = -13,
 
+  // tail calls
+  tok_tail = -14,
+
+  // loops
+  tok_while = -15, tok_for = -16, tok_in = -17, tok_range = -18,
+
+  // local bindings
+  tok_let = -19,
+
+  // embedded files
+  tok_embed = -20, tok_string = -21,
+
+  // top-level constants
+  tok_constant = -22,
+
+  // effect annotations
+  tok_pure = -23, tok_memo = -24,
+
 };
 
 int gettok();
 
-const std::string getIdentifierStr();
+// identifier and number values are only valid until the next gettok()
+Symbol getIdentifierSymbol();
+const std::string &getIdentifierStr();
 double getNumberVal();
-int getIntegerVal();
+int64_t getIntegerVal();
+const std::string &getStringVal();
 
 typedef struct T_SourceLocation {
 
@@ -49,5 +73,9 @@ typedef struct T_SourceLocation {
 SourceLocation getCurrentLocation();
 
 void InitializeLexer();
+bool OpenSourceFile(const char *filename);
+
+// a path named in the source, relative to the source file's directory
+std::string getSourceRelativePath(const std::string &path);
 
 #endif
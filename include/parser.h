@@ -12,6 +12,7 @@ ExprAST *ParseTopLevelExpr();
 FunctionAST *ParseFunctionDefinition();
 PrototypeAST *ParseExternalDeclaration();
 ValueTypeAST *ParseValueTypeDefinition();
+ConstantAST *ParseConstantDefinition();
 
 void InstallDefaultPrecedence();
 
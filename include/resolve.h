@@ -0,0 +1,101 @@
+// name resolution
+
+#ifndef _RESOLVE_H
+#define _RESOLVE_H
+
+#include <unordered_map>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+
+#include "symbols.h"
+#include "types.h"
+
+class ExprAST;
+class FunctionAST;
+
+// a declared function, shared by every call that resolves to it
+//
+// In an interactive session a defined function is called through Entry,
+// a pointer to its current body, so it can be redefined.  Definition is
+// the folded body, kept for compile-time evaluation.  Effect is inferred
+// from the body when it is compiled, externals have any effect unless
+// declared pure.  A generic function has no code of its own, calls to it
+// are typechecked against an instance made from Generic.
+
+struct FunctionBinding {
+  Symbol Name;
+  FunctionTypeData *Type;
+  llvm::Function *Code;
+  llvm::GlobalVariable *Entry;
+  FunctionAST *Definition;
+  Effect Effects;
+  FunctionAST *Generic;
+
+  FunctionBinding(Symbol name)
+    : Name(name), Type(0), Code(0), Entry(0), Definition(0), Effects(effect_any), Generic(0) {}
+};
+
+FunctionBinding *DeclareFunction(Symbol name);
+FunctionBinding *LookupFunction(Symbol name);
+
+// a top-level constant, either folded to Literal or kept in Global once
+// its initializer has run
+
+struct ConstantBinding {
+  Symbol Name;
+  TypeData *Type;
+  ExprAST *Literal;
+  llvm::GlobalVariable *Global;
+
+  ConstantBinding(Symbol name)
+    : Name(name), Type(0), Literal(0), Global(0) {}
+};
+
+// zero if the name is already taken
+ConstantBinding *DeclareConstant(Symbol name);
+ConstantBinding *LookupConstant(Symbol name);
+
+// the self calls found while marking a function's tail positions
+
+struct TailCalls {
+  FunctionBinding *Self;
+  unsigned Direct;          // plain calls in tail position
+  unsigned Accumulated;     // calls under an accumulating operator
+  char Operator;            // the first such operator
+  bool Mixed;               // set if they don't all agree
+
+  TailCalls(FunctionBinding *self)
+    : Self(self), Direct(0), Accumulated(0), Operator(0), Mixed(false) {}
+};
+
+// names visible at a point in a function body, each bound to a value slot
+// numbered from zero within the function
+
+class Scope {
+  Scope *Parent;
+  unsigned *SlotCount;
+  std::unordered_map<Symbol, unsigned> Bindings;
+
+public:
+  Scope(unsigned *slotCount)
+    : Parent(0), SlotCount(slotCount) {}
+  Scope(Scope *parent)
+    : Parent(parent), SlotCount(parent->SlotCount) {}
+
+  unsigned bind(Symbol name) {
+    unsigned slot = (*SlotCount)++;
+    Bindings[name] = slot;
+    return slot;
+  }
+
+  int lookup(Symbol name) const {
+    for (const Scope *s = this; s; s = s->Parent) {
+      std::unordered_map<Symbol, unsigned>::const_iterator found = s->Bindings.find(name);
+      if (found != s->Bindings.end()) return found->second;
+    }
+    return -1;
+  }
+};
+
+#endif
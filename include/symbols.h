@@ -0,0 +1,30 @@
+// symbols
+
+#ifndef _SYMBOLS_H
+#define _SYMBOLS_H
+
+#include <string>
+
+// interned identifiers: equal names always get the same handle
+
+typedef unsigned Symbol;
+
+// well-known names, interned in this order before anything else
+enum PredefinedSymbol {
+  sym_empty = 0,
+  sym_void,
+  sym_boolean,
+  sym_byte,
+  sym_integer,
+  sym_number,
+  sym_malloc,
+  sym_length,
+};
+
+Symbol internSymbol(const char *str, unsigned length);
+Symbol internSymbol(const std::string &str);
+
+const std::string &getSymbolName(Symbol symbol);
+unsigned getSymbolCount();
+
+#endif
@@ -5,9 +5,12 @@
 
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "arena.h"
 #include "context.h"
+#include "symbols.h"
 
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/IRBuilder.h"
@@ -17,31 +20,51 @@
 
 typedef llvm::Value *(*ConversionFunction)(llvm::IRBuilder<>, llvm::Value *);
 
+class TypeData;
+
+// the types bound to a generic function's type parameters, zero until known
+typedef std::map<Symbol, TypeData *> TypeParameters;
+
 // type specifiers
 
-class TypeSpecifier {
+class TypeSpecifier : public ArenaNode {
 public:
   virtual std::string getName() = 0;
+  virtual TypeData *getTypeData() = 0;
+
+  // binds the parameters this names to the parts of an actual type, false
+  // if one is already bound to something else
+  virtual bool Match(TypeData *actual, TypeParameters &params) = 0;
+
+  // the type named once the parameters are bound, zero if one isn't
+  virtual TypeData *Instantiate(const TypeParameters &params) = 0;
 };
 
 class BasicTypeSpecifier : public TypeSpecifier {
-  std::string name;
+  Symbol name;
 
 public:
-  BasicTypeSpecifier(const std::string &name) : name(name) {}
+  BasicTypeSpecifier(Symbol name) : name(name) {}
+  BasicTypeSpecifier(const std::string &name) : name(internSymbol(name)) {}
 
-  std::string getName() { return name; }
+  std::string getName() { return getSymbolName(name); }
+  TypeData *getTypeData();
+  bool Match(TypeData *actual, TypeParameters &params);
+  TypeData *Instantiate(const TypeParameters &params);
 };
 
 class FunctionTypeSpecifier : public TypeSpecifier {
   TypeSpecifier *returnType;
-  std::vector<TypeSpecifier *> parameterTypes;
+  ArenaArray<TypeSpecifier *> parameterTypes;
 
 public:
-  FunctionTypeSpecifier(TypeSpecifier *returns, std::vector<TypeSpecifier *> takes)
+  FunctionTypeSpecifier(TypeSpecifier *returns, const std::vector<TypeSpecifier *> &takes)
     : returnType(returns), parameterTypes(takes) {}
 
   std::string getName();
+  TypeData *getTypeData();
+  bool Match(TypeData *actual, TypeParameters &params);
+  TypeData *Instantiate(const TypeParameters &params);
 };
 
 class ArrayTypeSpecifier : public TypeSpecifier {
@@ -52,25 +75,55 @@ public:
     : elementType(elType) {}
 
   std::string getName();
+  TypeData *getTypeData();
+  bool Match(TypeData *actual, TypeParameters &params);
+  TypeData *Instantiate(const TypeParameters &params);
+};
+
+class SliceTypeSpecifier : public TypeSpecifier {
+  TypeSpecifier *elementType;
+
+public:
+  SliceTypeSpecifier(TypeSpecifier *elType)
+    : elementType(elType) {}
+
+  std::string getName();
+  TypeData *getTypeData();
+  bool Match(TypeData *actual, TypeParameters &params);
+  TypeData *Instantiate(const TypeParameters &params);
 };
 
 // types
+//
+// Types are hash-consed: structurally equal types are the same object, so
+// they can be compared by pointer or by their ID.
 
 class TypeData {
-  static std::map<std::string, TypeData *> types;
+  static std::unordered_map<Symbol, TypeData *> types;
+  static std::vector<TypeData *> typesByID;
+
+  unsigned id;
 
 public:
+  TypeData() : id(typesByID.size()) { typesByID.push_back(this); }
+
+  unsigned getID() const { return id; }
+  static TypeData *getTypeByID(unsigned id) { return typesByID[id]; }
+
   virtual std::string  getName()     = 0;
   virtual llvm::Type  *getLLVMType() = 0;
   virtual llvm::DIType getDIType(DebugContext *context) = 0;
 
   virtual bool isStructType() { return false; }
   virtual bool isArrayType() { return false; }
+  virtual bool isSliceType() { return false; }
+  virtual bool isFunctionType() { return false; }
   virtual bool canConvertTo(TypeData *other) { return false; }
   virtual llvm::Value *convertTo(llvm::IRBuilder<> builder, TypeData *other, llvm::Value *value) { return 0; }
   virtual TypeData *getConverterType(TypeData *other) { return 0; }
 
-  static TypeData *getType(std::string name);
+  static TypeData *getType(Symbol name);
+  static TypeData *getType(const std::string &name);
   static TypeData *getType(TypeSpecifier *specifier);
   static void registerType(TypeData *type);
 
@@ -80,22 +133,34 @@ class FunctionTypeData : public TypeData {
   TypeData *returnType;
   std::vector<TypeData *> parameterTypes;
 
-  static std::map<std::string, FunctionTypeData *> functionTypes;
+  std::string name;
+  llvm::FunctionType *functionType;
+  llvm::DIType diType;
+  bool hasDIType;
+  llvm::DIType pointerDIType;
+  bool hasPointerDIType;
+
+  FunctionTypeData(TypeData *returns, const std::vector<TypeData *> &takes)
+  : returnType(returns), parameterTypes(takes), functionType(0), hasDIType(false), hasPointerDIType(false) {}
 
 public:
-  FunctionTypeData(TypeData *returns, std::vector<TypeData *> takes)
-  : returnType(returns), parameterTypes(takes) {}
+  static FunctionTypeData *get(TypeData *returns, const std::vector<TypeData *> &takes);
 
   virtual std::string getName();
-  virtual llvm::Type *getLLVMType();
+
+  // a function value is a pointer to the function
+  virtual llvm::Type *getLLVMType() { return getFunctionType()->getPointerTo(); }
   virtual llvm::DIType getDIType(DebugContext *context);
+  virtual bool isFunctionType() { return true; }
+
+  // the signature of the functions pointed to, and its debug type
+  llvm::FunctionType *getFunctionType();
+  llvm::DIType getSubroutineDIType(DebugContext *context);
 
   unsigned getNumParameters() { return parameterTypes.size(); }
   TypeData *getParameterType(unsigned i) { return parameterTypes[i]; }
   TypeData *getReturnType() { return returnType; }
 
-  static FunctionTypeData *getFunctionType(std::string name);
-  static void registerFunctionType(std::string name, FunctionTypeData *type);
 };
 
 class BasicTypeData : public TypeData {
@@ -125,14 +190,19 @@ public:
 class StructTypeData : public TypeData {
   std::string name;
   std::vector<TypeData *> fieldTypes;
-  std::vector<std::string> fieldNames;
+  std::vector<Symbol> fieldNames;
+  std::unordered_map<Symbol, unsigned> fieldIndices;
   llvm::Type *llvmType;
   llvm::DIType diType;
   bool hasDIType;
 
 public:
-  StructTypeData(std::string n, const std::vector<TypeData *> &fts, const std::vector<std::string> &fns)
-  : name(n), fieldTypes(fts), fieldNames(fns), llvmType(0), hasDIType(false) {}
+  StructTypeData(std::string n, const std::vector<TypeData *> &fts, const std::vector<Symbol> &fns)
+  : name(n), fieldTypes(fts), fieldNames(fns), llvmType(0), hasDIType(false) {
+    for (unsigned i = 0, e = fieldNames.size(); i < e; i++) {
+      fieldIndices.insert(std::make_pair(fieldNames[i], i));
+    }
+  }
 
   virtual std::string getName() { return name; }
   virtual llvm::Type *getLLVMType();
@@ -141,26 +211,28 @@ public:
 
   unsigned getNumFields() { return fieldTypes.size(); }
   TypeData *getFieldType(unsigned i) { return fieldTypes[i]; }
-  TypeData *getFieldType(std::string s) {
+  TypeData *getFieldTypeByName(Symbol s) {
     int i = getFieldIndex(s);
     return i == -1 ? 0 : getFieldType(i);
   }
-  int getFieldIndex(std::string s) {
-    for (unsigned i = 0, e = fieldNames.size(); i < e; i++) {
-      if (s == fieldNames[i]) {
-        return i;
-      }
-    }
-    return -1;
+  int getFieldIndex(Symbol s) {
+    std::unordered_map<Symbol, unsigned>::iterator found = fieldIndices.find(s);
+    return found == fieldIndices.end() ? -1 : (int)found->second;
   }
 };
 
 class ArrayTypeData : public TypeData {
   TypeData *MemberType;
+  llvm::Type *LLVMType;
+  llvm::DIType DebugType;
+  bool HasDebugType;
 
-public:
+protected:
   ArrayTypeData(TypeData *memberType)
-    : MemberType(memberType) {}
+    : MemberType(memberType), LLVMType(0), HasDebugType(false) {}
+
+public:
+  static ArrayTypeData *get(TypeData *memberType);
 
   virtual std::string getName();
   virtual llvm::Type *getLLVMType();
@@ -203,6 +275,41 @@ public:
   }
 };
 
+// a view of part of an array, sharing its storage: the array, the offset
+// of the first element and the number of elements
+
+class SliceTypeData : public TypeData {
+  ArrayTypeData *ArrayType;
+  llvm::Type *LLVMType;
+  llvm::DIType DebugType;
+  bool HasDebugType;
+
+  SliceTypeData(ArrayTypeData *arrayType)
+    : ArrayType(arrayType), LLVMType(0), HasDebugType(false) {}
+
+public:
+  static SliceTypeData *get(TypeData *memberType);
+
+  virtual std::string getName();
+  virtual llvm::Type *getLLVMType();
+  virtual llvm::DIType getDIType(DebugContext *context);
+
+  virtual bool isSliceType() { return true; }
+
+  TypeData *getMemberType() { return ArrayType->getMemberType(); }
+  ArrayTypeData *getArrayType() { return ArrayType; }
+};
+
+// what calling a function may do, ordered so the larger effect wins
+
+enum Effect {
+  effect_none,      // computes its result from its arguments alone
+  effect_reads,     // also reads memory, such as array elements
+  effect_caches,    // pure, but fills a memo table on the way
+  effect_loops,     // pure, but may not return, as a loop or recursion
+  effect_any        // writes memory or calls out
+};
+
 // static methods
 
 void InitializeBasicTypes(llvm::LLVMContext &context, llvm::DIBuilder *builder);
@@ -0,0 +1,92 @@
+// arena allocation
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "arena.h"
+
+static const size_t ChunkSize = 64 * 1024;
+
+Arena::~Arena() {
+  while (Chunks) {
+    Chunk *next = Chunks->Next;
+    free(Chunks);
+    Chunks = next;
+  }
+}
+
+void Arena::addChunk(size_t minimum) {
+  size_t size = sizeof(Chunk) + minimum + alignof(double);
+  if (size < ChunkSize) size = ChunkSize;
+
+  Chunk *chunk = (Chunk *)malloc(size);
+  if (!chunk) throw std::bad_alloc();
+
+  chunk->Next = Chunks;
+  chunk->Size = size;
+  Chunks = chunk;
+
+  Cur = (char *)(chunk + 1);
+  End = (char *)chunk + size;
+}
+
+void *Arena::Allocate(size_t size, size_t align) {
+  uintptr_t p = ((uintptr_t)Cur + align - 1) & ~(uintptr_t)(align - 1);
+
+  if (!Cur || p + size > (uintptr_t)End) {
+    addChunk(size + align);
+    p = ((uintptr_t)Cur + align - 1) & ~(uintptr_t)(align - 1);
+  }
+
+  Cur = (char *)(p + size);
+  BytesAllocated += size;
+
+  return (void *)p;
+}
+
+void Arena::Release() {
+  if (!Chunks) return;
+
+  // keep the most recent chunk around for the next item
+  Chunk *keep = Chunks;
+  Chunk *rest = keep->Next;
+  while (rest) {
+    Chunk *next = rest->Next;
+    free(rest);
+    rest = next;
+  }
+
+  keep->Next = 0;
+  Chunks = keep;
+  Cur = (char *)(keep + 1);
+  End = (char *)keep + keep->Size;
+  BytesAllocated = 0;
+}
+
+// chunks are linked newest first, so the ones added since the mark come
+// before its chunk
+void Arena::Rewind(const Mark &mark) {
+  while (Chunks != mark.Chunks) {
+    Chunk *next = Chunks->Next;
+    free(Chunks);
+    Chunks = next;
+  }
+
+  Cur = mark.Cur;
+  End = Chunks ? (char *)Chunks + Chunks->Size : 0;
+  BytesAllocated = mark.BytesAllocated;
+}
+
+// current AST arena
+
+static Arena DefaultArena;
+static Arena *CurrentArena = &DefaultArena;
+
+void SetASTArena(Arena *arena) {
+  CurrentArena = arena ? arena : &DefaultArena;
+}
+
+Arena *GetASTArena() {
+  return CurrentArena;
+}
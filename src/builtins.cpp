@@ -10,34 +10,17 @@ static Function *initializeMalloc() {
   TypeSpecifier *returnType = new ArrayTypeSpecifier(new BasicTypeSpecifier("byte"));
 
   std::vector<TypeSpecifier *> argTypes;
-  std::vector<std::string> argNames;
+  std::vector<Symbol> argNames;
   argTypes.push_back(new BasicTypeSpecifier("integer"));
-  argNames.push_back("size");
+  argNames.push_back(internSymbol("size"));
 
-  PrototypeAST *proto = new PrototypeAST(loc, "malloc", returnType, argTypes, argNames);
+  PrototypeAST *proto = new PrototypeAST(loc, sym_malloc, returnType, argTypes, argNames);
+  proto->Resolve(0);
 
   return proto->Codegen();
 }
 
-static Function *initializeLength(std::string elType) {
-  SourceLocation loc = { 0, 0 };
-
-  std::string functionName = "length.";
-  functionName += elType;
-
-  TypeSpecifier *returnType = new BasicTypeSpecifier("integer");
-
-  std::vector<TypeSpecifier *> argTypes;
-  std::vector<std::string> argNames;
-
-  argTypes.push_back(new ArrayTypeSpecifier(new BasicTypeSpecifier(elType)));
-  argNames.push_back("array");
-
-  PrototypeAST *proto = new PrototypeAST(loc, functionName, returnType, argTypes, argNames);
-
-//  ExprAST *body = new 
-  return 0;
-}
+// length(a) is computed in place for any array or slice, see CallExprAST
 
 void InitializeBuiltins() {
   initializeMalloc();
@@ -1,14 +1,34 @@
 // cli
 
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
 
 #include "lexer.h"
 #include "parser.h"
 #include "codegen.h"
 #include "typecheck.h"
 #include "builtins.h"
+#include "emit.h"
+#include "evaluate.h"
+#include "jit.h"
 
 static bool showPrompt = true;
+static unsigned optLevel = 0;
+
+static const int DefaultSpecializationBudget = 2000;
+
+// an interactive session compiles and runs each item as it is entered
+static bool session = false;
+
+// top-level expressions are kept until main is generated, constants for
+// folding, and function definitions while calls may still be evaluated
+// against them or instantiate them, so in a session only generic ones;
+// everything else is released once its item has been compiled, and the
+// rest once main is
+static Arena TopLevelArena;
+static Arena DefinitionArena;
+static Arena ItemArena;
 
 static void prompt() {
   if (showPrompt) fprintf(stderr, "ready> ");
@@ -21,25 +41,79 @@ static void prime() {
 
 std::vector<ExprAST*> TopLevelExpressions;
 
+static bool isPrintable(TypeData *T) {
+  return T == TypeData::getType(sym_boolean)
+      || T == TypeData::getType(sym_byte)
+      || T == TypeData::getType(sym_integer)
+      || T == TypeData::getType(sym_number);
+}
+
+static void runInSession(Function *code, TypeData *T) {
+  OptimizeCode(optLevel);
+  AddToSession(GetCodegenModule());
+
+  void *entry = GetSessionAddress(code);
+  if (!entry) return;
+
+  if (T == TypeData::getType(sym_boolean)) {
+    fprintf(stderr, "%s\n", ((bool (*)())entry)() ? "true" : "false");
+  }
+  else if (T == TypeData::getType(sym_byte)) {
+    fprintf(stderr, "%u\n", ((uint8_t (*)())entry)());
+  }
+  else if (T == TypeData::getType(sym_integer)) {
+    fprintf(stderr, "%lld\n", (long long)((int64_t (*)())entry)());
+  }
+  else if (T == TypeData::getType(sym_number)) {
+    fprintf(stderr, "%g\n", ((double (*)())entry)());
+  }
+  else {
+    ((void (*)())entry)();
+  }
+}
+
+static void defineInSession(FunctionBinding *binding, Function *code) {
+  OptimizeCode(optLevel);
+  AddToSession(GetCodegenModule());
+
+  // a first definition is compiled when something first refers to it
+  if (binding->Entry->getParent() != code->getParent())
+    ReplaceInSession(binding, code);
+}
+
 static Function* handleTopLevelExpression() {
   ExprAST *line = ParseTopLevelExpr();
   if (line) {
+    if (!line->Resolve(0)) return 0;
+
     TypeData *T = line->Typecheck();
     if (!T) return 0;
 
-    TopLevelExpressions.push_back(line);
+    line = line->Fold();
+
+    if (!session) TopLevelExpressions.push_back(line);
 
     if (!showPrompt) return 0;
 
     SourceLocation loc = getCurrentLocation();
 
-    TypeSpecifier *ts = new BasicTypeSpecifier(T->getName());
+    // the session only brings back values it can print
+    Symbol returns = !session || isPrintable(T) ? internSymbol(T->getName()) : sym_void;
+    TypeSpecifier *ts = new BasicTypeSpecifier(returns);
+
+    // main emits the line again, so the wrapper marks tail positions in a
+    // copy of its own
+    ExprAST *body = session ? line : line->Clone();
 
     // stick in an anonymous function
-    PrototypeAST *Proto = new PrototypeAST(loc, "", ts, std::vector<TypeSpecifier *>(), std::vector<std::string>());
-    FunctionAST *anonymous = new FunctionAST(Proto, line);
+    PrototypeAST *Proto = new PrototypeAST(loc, sym_empty, ts, std::vector<TypeSpecifier *>(), std::vector<Symbol>());
+    FunctionAST *anonymous = new FunctionAST(Proto, body);
+    if (!anonymous->Resolve()) return 0;
+
+    Function *code = anonymous->Codegen();
+    if (code && session) runInSession(code, T);
 
-    return anonymous->Codegen();
+    return code;
   }
   else {
     getNextToken();
@@ -47,13 +121,52 @@ static Function* handleTopLevelExpression() {
   return 0;
 }
 
+static Function* compileFunctionDefinition(FunctionAST *block) {
+  if (!block->Resolve()) return 0;
+
+  // instantiated by the calls to it
+  if (block->isGeneric()) return 0;
+
+  TypeData *T = block->Typecheck();
+  if (!T) return 0;
+
+  block->Fold();
+
+  Function *code = block->Codegen();
+  if (code && session) defineInSession(block->getPrototype()->getBinding(), code);
+
+  return code;
+}
+
 static Function* handleFunctionDefinition() {
+  Arena::Mark mark = DefinitionArena.getMark();
+
   FunctionAST *block = ParseFunctionDefinition();
-  if (block) {
-    TypeData *T = block->Typecheck();
-    if (!T) return 0;
+  if (!block) {
+    getNextToken();
+    DefinitionArena.Rewind(mark);
+    return 0;
+  }
 
-    return block->Codegen();
+  Function *code = compileFunctionDefinition(block);
+
+  // nothing refers to a definition its binding doesn't keep
+  FunctionBinding *binding = block->getPrototype()->getBinding();
+  if (!binding || (binding->Definition != block && binding->Generic != block))
+    DefinitionArena.Rewind(mark);
+
+  return code;
+}
+
+static Function* handleExternalDeclaration() {
+  PrototypeAST *proto = ParseExternalDeclaration();
+  if (proto) {
+    if (!proto->Resolve(0)) return 0;
+
+    Function *code = proto->Codegen();
+    if (code && session) AddToSession(GetCodegenModule());
+
+    return code;
   }
   else {
     getNextToken();
@@ -61,10 +174,21 @@ static Function* handleFunctionDefinition() {
   return 0;
 }
 
-static Function* handleExternalDeclaration() {
-  PrototypeAST *proto = ParseExternalDeclaration();
-  if (proto) {
-    return proto->Codegen();
+static Function* handleConstantDefinition() {
+  ConstantAST *constant = ParseConstantDefinition();
+  if (constant) {
+    if (!constant->Resolve()) return 0;
+    if (!constant->Typecheck()) return 0;
+
+    constant->Fold();
+    if (!constant->Codegen()) return 0;
+
+    // a session runs the initializer right away, otherwise main does
+    Function *init = constant->getInitializer();
+    if (session && init) runInSession(init, TypeData::getType(sym_void));
+    else if (session) AddToSession(GetCodegenModule());
+
+    return init;
   }
   else {
     getNextToken();
@@ -95,18 +219,40 @@ static void handleValueTypeDefinition() {
 }
 
 static void handleNext(int token) {
-  Function* code;
+  if (session) BeginIncrementalModule();
+
+  Function* code = 0;
   switch (token) {
-    default:            code = handleTopLevelExpression(); break;
-    case tok_function:  code = handleFunctionDefinition(); break;
+    default:
+      // the session runs expressions right away, nothing is kept for main
+      SetASTArena(session ? &ItemArena : &TopLevelArena);
+      code = handleTopLevelExpression();
+      SetASTArena(&ItemArena);
+      break;
+    case tok_function:
+    case tok_memo:
+      // kept for evaluating calls, and a generic one for instantiating,
+      // rewound otherwise
+      SetASTArena(&DefinitionArena);
+      code = handleFunctionDefinition();
+      SetASTArena(&ItemArena);
+      break;
+    case tok_constant:
+      // kept for folding every later use
+      SetASTArena(&DefinitionArena);
+      code = handleConstantDefinition();
+      SetASTArena(&ItemArena);
+      break;
     case tok_external:  code = handleExternalDeclaration(); break;
     case tok_value:     handleValueTypeDefinition(); break;
   }
 
-  if (code && showPrompt) {
+  if (code && showPrompt && !session) {
     code->dump();
   }
 
+  ItemArena.Release();
+
   prompt();
 }
 
@@ -121,31 +267,192 @@ static void mainLoop() {
   }
 }
 
+static bool isOptLevelFlag(const std::string &arg) {
+  return arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3';
+}
+
+// output file named after the source, e.g. foo.eric -> foo.o
+static std::string defaultOutputName(const std::string &filename, OutputKind kind) {
+  std::string base = filename;
+  size_t dot = base.rfind('.');
+  size_t slash = base.rfind('/');
+  if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    base.erase(dot);
+
+  switch (kind) {
+  case output_ir:       return base + ".ll";
+  case output_bitcode:  return base + ".bc";
+  case output_assembly: return base + ".s";
+  case output_object:   return base + ".o";
+  }
+  return base;
+}
+
+static int usage(const char *program) {
+  fprintf(stderr, "usage: %s [-c [file.eric]] [-O0|-O1|-O2|-O3] [-fbounds-checks] [-fspecialize-budget=N] [-fspecialize-report] [-o file] [-S|-emit-bc|-emit-llvm]\n", program);
+  fprintf(stderr, "       %s -run [file.eric] [-O0|-O1|-O2|-O3] [-fbounds-checks] [-fspecialize-budget=N] [-fspecialize-report] [-time]\n", program);
+  return 1;
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
 int main(int argc, char** argv) {
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
   std::string flag = "-c";
   std::string filename = "a.eric";
-  if (argc > 1 && flag == argv[1]) {
-    showPrompt = false;
+  bool readFile = false;
+
+  // without -o or an -emit flag the IR is dumped to stderr
+  std::string outputFile;
+  OutputKind outputKind = output_object;
+  bool writeOutput = false;
+
+  // -run compiles in memory and calls main instead
+  bool runProgram = false;
+  bool reportTime = false;
+
+  // array indexing is unchecked unless asked for
+  bool boundsChecks = false;
+
+  // instructions spent on call-site specialization, by default only from -O2
+  int specializationBudget = -1;
+  bool specializationReport = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+
+    if (arg == flag || arg == "-run") {
+      showPrompt = false;
+      runProgram = arg == "-run";
+
+      if (i + 1 < argc && argv[i + 1][0] != '-') {
+        filename = argv[++i];
+        readFile = true;
+      }
+    }
+    else if (isOptLevelFlag(arg)) {
+      optLevel = arg[2] - '0';
+    }
+    else if (arg == "-o") {
+      if (i + 1 >= argc) return usage(argv[0]);
+
+      outputFile = argv[++i];
+      writeOutput = true;
+    }
+    else if (arg == "-S") {
+      outputKind = output_assembly;
+      writeOutput = true;
+    }
+    else if (arg == "-emit-bc") {
+      outputKind = output_bitcode;
+      writeOutput = true;
+    }
+    else if (arg == "-emit-llvm") {
+      outputKind = output_ir;
+      writeOutput = true;
+    }
+    else if (arg == "-time") {
+      reportTime = true;
+    }
+    else if (arg == "-fbounds-checks") {
+      boundsChecks = true;
+    }
+    else if (arg.compare(0, 20, "-fspecialize-budget=") == 0) {
+      std::string count = arg.substr(20);
+      if (count.empty() || count.find_first_not_of("0123456789") != std::string::npos)
+        return usage(argv[0]);
 
-    if (argc > 2) filename = argv[2];
+      specializationBudget = atoi(count.c_str());
+    }
+    else if (arg == "-fspecialize-report") {
+      specializationReport = true;
+    }
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return usage(argv[0]);
+    }
   }
 
+  if (runProgram && writeOutput) {
+    fprintf(stderr, "-run doesn't write an output file\n");
+    return usage(argv[0]);
+  }
+
+  if (writeOutput && outputFile.empty())
+    outputFile = defaultOutputName(filename, outputKind);
+
+  SetASTArena(&ItemArena);
+
   InitializeLexer();
+
+  if (readFile && !OpenSourceFile(filename.c_str())) {
+    fprintf(stderr, "Error opening source file %s\n", filename.c_str());
+    return 1;
+  }
   InstallDefaultPrecedence();
 
   prime();
 
-  InitializeCodegen(filename.c_str());
+  if (!InitializeTarget(optLevel) && writeOutput && outputKind != output_ir)
+    return 1;
+
+  InitializeCodegen(filename.c_str(), optLevel);
+  if (boundsChecks) EnableBoundsChecks();
+  if (specializationBudget < 0) specializationBudget = optLevel >= 2 ? DefaultSpecializationBudget : 0;
+  EnableSpecialization(specializationBudget, specializationReport);
   InitializeTypecheck();
   InitializeBuiltins();
 
+  session = showPrompt && !writeOutput;
+  if (session && !InitializeSession(GetCodegenModule(), optLevel))
+    return 1;
+
+  InitializeEvaluator(session);
+
   mainLoop();
 
+  if (session) {
+    fprintf(stderr, "\n");
+    return 0;
+  }
+
   CreateMainFunction(TopLevelExpressions);
 
+  // nothing is folded, evaluated or instantiated once main is emitted
+  TopLevelExpressions.clear();
+  TopLevelArena.Release();
+  DefinitionArena.Release();
+
   if (showPrompt) fprintf(stderr, "\n\n\n");
 
-  DumpAllCode();
+  FinalizeCode();
+  OptimizeCode(optLevel);
+
+  if (runProgram) {
+    MainFunction entry = CompileForExecution(GetCodegenModule(), optLevel);
+    if (!entry) return 1;
+
+    if (reportTime)
+      fprintf(stderr, "time to first instruction: %.3f ms\n", millisecondsSince(startTime));
+
+    int64_t result = entry();
+
+    if (reportTime)
+      fprintf(stderr, "total time: %.3f ms\n", millisecondsSince(startTime));
+
+    return (int)result;
+  }
+
+  if (!writeOutput) {
+    DumpAllCode();
+  }
+  else if (!EmitToFile(GetCodegenModule(), outputFile.c_str(), outputKind)) {
+    return 1;
+  }
 
   return 0;
 }
@@ -1,5 +1,6 @@
 // codegen
 
+#include <algorithm>
 #include <cstdio>
 #include <string>
 #include <map>
@@ -7,15 +8,22 @@
 
 #include "ast.h"
 #include "context.h"
+#include "emit.h"
+#include "resolve.h"
 
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IR/TypeBuilder.h"
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/DebugInfo.h"
 #include "llvm/IR/DIBuilder.h"
+#include "llvm/PassManager.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 
 void CompilerError(SourceLocation loc, const char *message) {
   fprintf(stderr, "Error while compiling at line %i, column %i: %s\n", loc.Line, loc.Column, message);
@@ -34,9 +42,84 @@ Function *ErrorF2(SourceLocation loc, const char *message) {
 // GLOBALS
 
 static Module *TheModule;
+static unsigned OptLevel;
 static DataLayout *DL;
 static IRBuilder<> Builder(getGlobalContext());
-static std::map<std::string, Value*> NamedValues;
+static std::vector<Value*> SlotValues;
+
+// bounds checks
+//
+// With -fbounds-checks an out of range index traps.  A check is left out
+// when the index is already known to be in range of the array: it was
+// checked before on every path here, it runs over a loop range ending at
+// the array's length, or a dominating comparison put it below the length
+// while another, or a loop range from zero, kept it from being negative.
+// Each fact holds until the branch or loop body it was found in ends.
+
+static bool BoundsChecks = false;
+
+struct InBounds {
+  Value *Index;
+  Value *Array;
+};
+
+static std::vector<InBounds> KnownInBounds;
+static std::map<Value *, Value *> ArrayCounts;   // loaded length -> array or slice
+static std::vector<Value *> NonNegative;
+
+// the facts known on entry to a branch or loop body, to go back to after it
+struct KnownFacts {
+  unsigned InBounds;
+  unsigned NonNegative;
+};
+
+static KnownFacts rememberFacts() {
+  KnownFacts known = { (unsigned)KnownInBounds.size(), (unsigned)NonNegative.size() };
+  return known;
+}
+
+static void forgetFacts(const KnownFacts &known) {
+  KnownInBounds.resize(known.InBounds);
+  NonNegative.resize(known.NonNegative);
+}
+
+// in an interactive session every item gets a module of its own
+static bool Incremental = false;
+static unsigned SessionVersions = 0;
+
+// constants that couldn't be folded, run in order at the start of main
+static std::vector<Function *> ConstantInitializers;
+
+// call-site specialization
+//
+// A call with constant arguments to a function already compiled gets a
+// clone with those arguments folded in.  Clones are shared by calls with
+// the same constants, and stop once their instructions use up the budget.
+
+static unsigned SpecializationBudget = 0;
+static bool SpecializationReport = false;
+
+struct Specialization {
+  Function *Callee;
+  std::vector<Constant *> Arguments;    // zero where the call passes a value
+
+  bool operator<(const Specialization &other) const {
+    if (Callee != other.Callee) return Callee < other.Callee;
+    return Arguments < other.Arguments;
+  }
+};
+
+static std::map<Specialization, Function *> Specializations;
+
+// a function that calls itself in tail position loops back to the top
+static FunctionBinding *TailLoopBinding = 0;
+static BasicBlock *TailLoopHeader = 0;
+static std::vector<PHINode *> TailLoopArguments;
+
+// from -O1, 'x + f(...)' and the like carry x around the loop instead of
+// waiting for the call to return
+static PHINode *TailLoopAccumulator = 0;
+static char TailLoopOperator = 0;
 
 // debug info
 
@@ -86,10 +169,14 @@ void InitializeDataLayout(Module *m) {
   DL = new DataLayout(m);
 }
 
-void InitializeCodegen(const char *filename) {
+void InitializeCodegen(const char *filename, unsigned optLevel) {
   LLVMContext &Context = getGlobalContext();
+  OptLevel = optLevel;
+
   TheModule = new Module("eric repl", Context);
 
+  ConfigureModuleForTarget(TheModule);
+
   TheModule->addModuleFlag(Module::Warning, "Debug Info Version", DEBUG_METADATA_VERSION);
 
   DBuilder = new DIBuilder(*TheModule);
@@ -114,13 +201,13 @@ void InitializeCodegen(const char *filename) {
 
 static DIType getDebugType(Type *type) {
   if (type->isIntegerTy(1)) {
-    return TypeData::getType("boolean")->getDIType(EricDebugInfo.DebugContext);
+    return TypeData::getType(sym_boolean)->getDIType(EricDebugInfo.DebugContext);
   }
   else if (type->isIntegerTy()) {
-    return TypeData::getType("integer")->getDIType(EricDebugInfo.DebugContext);
+    return TypeData::getType(sym_integer)->getDIType(EricDebugInfo.DebugContext);
   }
   else { //if (type->isFloatingPointTy()) {
-    return TypeData::getType("number")->getDIType(EricDebugInfo.DebugContext);
+    return TypeData::getType(sym_number)->getDIType(EricDebugInfo.DebugContext);
   }
 }
 
@@ -138,29 +225,38 @@ static DICompositeType CreateFunctionType(FunctionType *type) {
   return DBuilder->createSubroutineType(EricDebugInfo.Unit, paramTypeArray);
 }
 
-void CreateMainFunction(std::vector<ExprAST*> expressions) {
-  FunctionType *mainType = TypeBuilder<types::i<64>(), true>::get(getGlobalContext());
-  Function *main = Function::Create(mainType, Function::ExternalLinkage, "main", TheModule);
-
+// for functions that aren't written in the source, like main
+static DISubprogram createGeneratedSubprogram(Function *F) {
   DIDescriptor fContext(EricDebugInfo.Unit);
-  DISubprogram SP = DBuilder->createFunction(
+  return DBuilder->createFunction(
     fContext,                                   // file
-    "main",                                     // name
+    F->getName(),                               // name
     "",                                         // ??
     EricDebugInfo.Unit,                         // file
     0,                                          // line number
-    CreateFunctionType(mainType),               // function type
-    false,                                      // internal linkage
+    CreateFunctionType(F->getFunctionType()),   // function type
+    F->hasInternalLinkage(),                    // internal linkage
     true,                                       // definition
     0,                                          // ??
     DIDescriptor::FlagPrototyped,               // flags
     false,                                      // ??
-    main                                        // the function
+    F                                           // the function
   );
+}
+
+void CreateMainFunction(std::vector<ExprAST*> expressions) {
+  FunctionType *mainType = TypeBuilder<types::i<64>(), true>::get(getGlobalContext());
+  Function *main = Function::Create(mainType, Function::ExternalLinkage, "main", TheModule);
+
+  DISubprogram SP = createGeneratedSubprogram(main);
 
   EricDebugInfo.LexicalBlocks.push_back(&SP);
   EricDebugInfo.clearLocation();
 
+  KnownInBounds.clear();
+  ArrayCounts.clear();
+  NonNegative.clear();
+
   BasicBlock *BB = BasicBlock::Create(getGlobalContext(), "entry", main);
   Builder.SetInsertPoint(BB);
 
@@ -168,6 +264,10 @@ void CreateMainFunction(std::vector<ExprAST*> expressions) {
 
   EricDebugInfo.emitLocation(0, 0);
 
+  for (unsigned i = 0, e = ConstantInitializers.size(); i < e; i++) {
+    Builder.CreateCall(ConstantInitializers[i]);
+  }
+
   for (unsigned i = 0, e = expressions.size(); i < e; i++) {
     EricDebugInfo.emitLocation(expressions[i]);
     result = expressions[i]->Codegen();
@@ -186,14 +286,263 @@ void CreateMainFunction(std::vector<ExprAST*> expressions) {
   verifyFunction(*main);
 }
 
-void DumpAllCode() {
+void BeginIncrementalModule() {
+  Incremental = true;
+
+  TheModule = new Module("eric repl", getGlobalContext());
+  ConfigureModuleForTarget(TheModule);
+}
+
+void EnableBoundsChecks() {
+  BoundsChecks = true;
+}
+
+void EnableSpecialization(unsigned budget, bool report) {
+  SpecializationBudget = budget;
+  SpecializationReport = report;
+}
+
+Module *GetCodegenModule() {
+  return TheModule;
+}
+
+void FinalizeCode() {
   // complete debug operations
   DBuilder->finalize();
+}
+
+void OptimizeCode(unsigned optLevel) {
+  if (optLevel == 0) return;
+
+  // the same pipeline clang builds for -O1 through -O3
+  PassManagerBuilder builder;
+  builder.OptLevel = optLevel;
+  builder.SizeLevel = 0;
+  builder.LoopVectorize = optLevel > 1;
+  builder.SLPVectorize = optLevel > 1;
+
+  if (optLevel > 1) {
+    builder.Inliner = createFunctionInliningPass(optLevel, 0);
+  }
+  else {
+    builder.Inliner = createAlwaysInlinerPass();
+  }
+
+  FunctionPassManager functionPasses(TheModule);
+  functionPasses.add(new DataLayoutPass(TheModule));
+  builder.populateFunctionPassManager(functionPasses);
+
+  PassManager modulePasses;
+  modulePasses.add(new DataLayoutPass(TheModule));
+  builder.populateModulePassManager(modulePasses);
+
+  functionPasses.doInitialization();
+  for (Module::iterator F = TheModule->begin(), E = TheModule->end(); F != E; ++F) {
+    if (!F->isDeclaration()) functionPasses.run(*F);
+  }
+  functionPasses.doFinalization();
+
+  modulePasses.run(*TheModule);
+}
 
+void DumpAllCode() {
   // dump code
   TheModule->dump();
 }
 
+// something defined in an earlier module of the session is declared again
+// in the current one, the JIT links them by name
+static Function *getFunctionInModule(Function *F) {
+  if (F->getParent() == TheModule) return F;
+
+  Function *local = TheModule->getFunction(F->getName());
+  if (local) return local;
+
+  return Function::Create(F->getFunctionType(), Function::ExternalLinkage, F->getName(), TheModule);
+}
+
+static GlobalVariable *getGlobalInModule(GlobalVariable *G) {
+  if (G->getParent() == TheModule) return G;
+
+  GlobalVariable *local = TheModule->getGlobalVariable(G->getName());
+  if (local) return local;
+
+  Type *T = G->getType()->getElementType();
+  return new GlobalVariable(*TheModule, T, false, GlobalValue::ExternalLinkage, 0, G->getName());
+}
+
+static Value *getCallee(FunctionBinding *binding) {
+  if (!binding->Code) return 0;
+
+  if (!binding->Entry) return getFunctionInModule(binding->Code);
+
+  return Builder.CreateLoad(getGlobalInModule(binding->Entry), "entrytmp");
+}
+
+static unsigned countInstructions(Function *F) {
+  unsigned count = 0;
+  for (Function::iterator BB = F->begin(), BE = F->end(); BB != BE; ++BB) {
+    count += BB->size();
+  }
+  return count;
+}
+
+// a musttail call needs its caller to keep the original prototype
+static bool hasMustTailCall(Function *F) {
+  for (Function::iterator BB = F->begin(), BE = F->end(); BB != BE; ++BB) {
+    for (BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE; ++I) {
+      CallInst *call = dyn_cast<CallInst>(I);
+      if (call && call->isMustTailCall()) return true;
+    }
+  }
+  return false;
+}
+
+static std::string describeArgument(Constant *c) {
+  if (!c) return "_";
+  if (ConstantInt *i = dyn_cast<ConstantInt>(c)) return std::to_string(i->getSExtValue());
+  if (ConstantFP *n = dyn_cast<ConstantFP>(c)) return std::to_string(n->getValueAPF().convertToDouble());
+  if (Function *f = dyn_cast<Function>(c)) return f->getName().str();
+  return "constant";
+}
+
+// the clone's debug locations move to a subprogram of its own, and the
+// arguments it no longer takes have nothing left to describe
+static void rescopeClone(Function *clone) {
+  DISubprogram SP = createGeneratedSubprogram(clone);
+
+  for (Function::iterator BB = clone->begin(), BE = clone->end(); BB != BE; ++BB) {
+    for (BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE; ) {
+      Instruction *inst = I++;
+      if (isa<DbgInfoIntrinsic>(inst)) {
+        inst->eraseFromParent();
+        continue;
+      }
+
+      DebugLoc loc = inst->getDebugLoc();
+      if (!loc.isUnknown()) inst->setDebugLoc(DebugLoc::get(loc.getLine(), loc.getCol(), SP));
+    }
+  }
+}
+
+// a recursive call passing the same constants, as a combinator passes its
+// function along, can stay in the clone
+static void redirectRecursion(Function *clone, const Specialization &key) {
+  for (Function::iterator BB = clone->begin(), BE = clone->end(); BB != BE; ++BB) {
+    for (BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE; ) {
+      CallInst *call = dyn_cast<CallInst>(I++);
+      if (!call || call->getCalledFunction() != key.Callee) continue;
+
+      std::vector<Value *> remaining;
+      bool same = true;
+      for (unsigned i = 0, e = key.Arguments.size(); i < e && same; i++) {
+        if (!key.Arguments[i]) remaining.push_back(call->getArgOperand(i));
+        else same = call->getArgOperand(i) == key.Arguments[i];
+      }
+      if (!same) continue;
+
+      CallInst *redirected = CallInst::Create(clone, remaining, "", call);
+      redirected->setTailCall(call->isTailCall());
+      redirected->setDebugLoc(call->getDebugLoc());
+      redirected->takeName(call);
+      call->replaceAllUsesWith(redirected);
+      call->eraseFromParent();
+    }
+  }
+}
+
+// the function to call instead of callee, or zero to call it as is; the
+// arguments folded into a clone are dropped from args
+static Function *specializeCall(Function *callee, std::vector<Value *> &args) {
+  Specialization key;
+  key.Callee = callee;
+
+  bool folding = false;
+  bool devirtualizing = false;
+  for (unsigned i = 0, e = args.size(); i < e; i++) {
+    Constant *c = dyn_cast<Constant>(args[i]);
+    if (c && isa<UndefValue>(c)) c = 0;
+
+    key.Arguments.push_back(c);
+    if (c) folding = true;
+    if (c && isa<Function>(c)) devirtualizing = true;
+  }
+  if (!folding) return 0;
+
+  std::map<Specialization, Function *>::iterator found = Specializations.find(key);
+  Function *clone = found == Specializations.end() ? 0 : found->second;
+
+  if (found == Specializations.end()) {
+    std::vector<Type *> params;
+    for (unsigned i = 0, e = args.size(); i < e; i++) {
+      if (!key.Arguments[i]) params.push_back(args[i]->getType());
+    }
+
+    FunctionType *FT = FunctionType::get(callee->getReturnType(), params, false);
+    clone = Function::Create(FT, GlobalValue::InternalLinkage, callee->getName().str() + ".specialized", TheModule);
+
+    ValueToValueMapTy VMap;
+    Function::arg_iterator CI = clone->arg_begin();
+    unsigned i = 0;
+    for (Function::arg_iterator AI = callee->arg_begin(), AE = callee->arg_end(); AI != AE; ++AI, ++i) {
+      if (key.Arguments[i]) {
+        VMap[AI] = key.Arguments[i];
+      }
+      else {
+        CI->setName(AI->getName());
+        VMap[AI] = CI++;
+      }
+    }
+
+    // pruning folds the constants through and drops the branches they decide
+    SmallVector<ReturnInst *, 4> returns;
+    CloneAndPruneFunctionInto(clone, callee, VMap, false, returns, "", 0, DL);
+
+    unsigned size = countInstructions(clone);
+    unsigned original = countInstructions(callee);
+
+    // a clone that folded nothing away isn't worth its size, unless it
+    // turned calls through a function argument into direct ones
+    if ((size >= original && !devirtualizing) || size > SpecializationBudget || hasMustTailCall(clone)) {
+      clone->eraseFromParent();
+      clone = 0;
+    }
+    else {
+      SpecializationBudget -= size;
+      rescopeClone(clone);
+      redirectRecursion(clone, key);
+
+      if (callee->hasFnAttribute(Attribute::NoUnwind)) clone->addFnAttr(Attribute::NoUnwind);
+      if (callee->hasFnAttribute(Attribute::ReadNone)) clone->addFnAttr(Attribute::ReadNone);
+      if (callee->hasFnAttribute(Attribute::ReadOnly)) clone->addFnAttr(Attribute::ReadOnly);
+
+      if (SpecializationReport) {
+        std::string call = callee->getName().str() + "(";
+        for (unsigned i = 0, e = key.Arguments.size(); i < e; i++) {
+          if (i) call += ", ";
+          call += describeArgument(key.Arguments[i]);
+        }
+        call += ")";
+
+        fprintf(stderr, "specialized %s as %s, %u of %u instructions\n",
+                call.c_str(), clone->getName().str().c_str(), size, original);
+      }
+    }
+
+    Specializations[key] = clone;
+  }
+
+  if (!clone) return 0;
+
+  std::vector<Value *> remaining;
+  for (unsigned i = 0, e = args.size(); i < e; i++) {
+    if (!key.Arguments[i]) remaining.push_back(args[i]);
+  }
+  args.swap(remaining);
+
+  return clone;
+}
+
 Value *BooleanExprAST::Codegen() {
   return ConstantInt::get(TypeBuilder<types::i<1>, true>::get(getGlobalContext()), Val);
 }
@@ -207,11 +556,31 @@ Value *NumberExprAST::Codegen() {
 }
 
 Value *VariableExprAST::Codegen() {
-  Value *V = NamedValues[Name];
+  if (Binding) {
+    if (!Binding->Global) {
+      std::string message = "Constant has no value: ";
+      message += getSymbolName(Name);
+      return ErrorV(this, message.c_str());
+    }
+
+    return Builder.CreateLoad(getGlobalInModule(Binding->Global), getSymbolName(Name));
+  }
+
+  if (FunctionRef) {
+    Value *F = getCallee(FunctionRef);
+    if (!F) {
+      std::string message = "Function has no code: ";
+      message += getSymbolName(Name);
+      return ErrorV(this, message.c_str());
+    }
+    return F;
+  }
+
+  Value *V = Slot < SlotValues.size() ? SlotValues[Slot] : 0;
 
   if (!V) {
     std::string message = "Unknown variable name: '";
-    message += Name;
+    message += getSymbolName(Name);
     message += "'";
     return ErrorV(this, message.c_str());
   }
@@ -219,15 +588,39 @@ Value *VariableExprAST::Codegen() {
   return V;
 }
 
+static Value *accumulatorIdentity(char op, Type *T) {
+  switch (op) {
+  case '*': return ConstantInt::get(T, 1);
+  case '&': return Constant::getAllOnesValue(T);
+  default:  return Constant::getNullValue(T);
+  }
+}
+
+static Value *accumulate(char op, Value *accumulator, Value *operand) {
+  switch (op) {
+  case '*': return Builder.CreateMul(accumulator, operand, "accumulatetmp");
+  case '&': return Builder.CreateAnd(accumulator, operand, "accumulatetmp");
+  case '|': return Builder.CreateOr(accumulator, operand, "accumulatetmp");
+  default:  return Builder.CreateAdd(accumulator, operand, "accumulatetmp");
+  }
+}
+
 Value *BinaryExprAST::Codegen() {
+  if (SelfCall && TailLoopAccumulator) {
+    Value *operand = Operand->Codegen();
+    if (!operand) return 0;
+
+    return SelfCall->CodegenAccumulated(Op, operand, this);
+  }
+
   Value *L = LHS->Codegen();
   Value *R = RHS->Codegen();
   if (!L || !R) return 0;
 
-  Type *T = Typecheck()->getLLVMType();
+  Type *T = getType()->getLLVMType();
   if (!T) return 0;
 
-  Type *LT = LHS->Typecheck()->getLLVMType();
+  Type *LT = LHS->getType()->getLLVMType();
 
   EricDebugInfo.emitLocation(this);
   if (T->isIntegerTy(1)) {
@@ -274,15 +667,73 @@ Value *BinaryExprAST::Codegen() {
   return ErrorV(this, "invalid types in binary operator");
 }
 
+// code after a tail call is never reached, but the enclosing expressions
+// still expect a value
+static Value *continueAfterTailCall(TypeData *type) {
+  Function *parent = Builder.GetInsertBlock()->getParent();
+  BasicBlock *after = BasicBlock::Create(getGlobalContext(), "aftertail", parent);
+  Builder.SetInsertPoint(after);
+
+  if (type == TypeData::getType(sym_void))
+    return UndefValue::get(TypeBuilder<types::i<1>, true>::get(getGlobalContext()));
+
+  return UndefValue::get(type->getLLVMType());
+}
+
+static Value *emitTailLoop(std::vector<Value *> &args, TypeData *type, Value *accumulated) {
+  BasicBlock *from = Builder.GetInsertBlock();
+  for (unsigned i = 0, e = args.size(); i < e; i++) {
+    TailLoopArguments[i]->addIncoming(args[i], from);
+  }
+
+  if (TailLoopAccumulator) {
+    TailLoopAccumulator->addIncoming(accumulated ? accumulated : TailLoopAccumulator, from);
+  }
+
+  Builder.CreateBr(TailLoopHeader);
+
+  return continueAfterTailCall(type);
+}
+
+static Value *loadLength(Value *sequence, TypeData *type);
+
+static Value *errorNotInTailPosition(ExprAST *call, Symbol callee) {
+  std::string message = "Call to ";
+  message += getSymbolName(callee);
+  message += " is marked tail but isn't in tail position";
+  return ErrorV(call, message.c_str());
+}
+
 Value *CallExprAST::Codegen() {
-  if (Callee == "integer" || Callee == "number" || Callee == "boolean") {
+  if (isBuiltin() && RequireTail) {
+    std::string message = getSymbolName(Callee);
+    message += " is built in and can't be a tail call";
+    return ErrorV(this, message.c_str());
+  }
+
+  if (isLength()) {
+    if (Args.size() != 1) {
+      return ErrorV(this, "length expects a single argument");
+    }
+
+    TypeData *type = Args[0]->getType();
+    if (!type) return 0;
+
+    Value *sequence = Args[0]->Codegen();
+    if (!sequence) return 0;
+
+    EricDebugInfo.emitLocation(this);
+    return loadLength(sequence, type);
+  }
+
+  if (isCast()) {
     if (Args.size() != 1) {
       return ErrorV(this, "Cast expects a single argument");
     }
 
     TypeData *target = TypeData::getType(Callee);
 
-    TypeData *source = Args[0]->Typecheck();
+    TypeData *source = Args[0]->getType();
     if (!source) return 0;
 
     if (source == target) {
@@ -297,21 +748,42 @@ Value *CallExprAST::Codegen() {
     }
     else {
       std::string message = "Unable to cast type to ";
-      message += Callee;
+      message += getSymbolName(Callee);
       return ErrorV(this, message.c_str());
     }
   }
 
-  Function *CalleeF = TheModule->getFunction(Callee);
-  if (!CalleeF) {
+  Value *CalleeF = Indirect ? (Slot < SlotValues.size() ? SlotValues[Slot] : 0) : 0;
+
+  if (Indirect ? !CalleeF : (!Binding || !Binding->Code)) {
     std::string message = "Unknown function reference: ";
-    message += Callee;
+    message += getSymbolName(Callee);
     return ErrorV(this, message.c_str());
   }
 
-  if (CalleeF->arg_size() != Args.size())
+  // musttail needs the caller and callee to agree on their prototypes
+  Function *caller = Builder.GetInsertBlock()->getParent();
+  FunctionType *calleeType = Indirect ? (FunctionType *)CalleeF->getType()->getPointerElementType()
+                                      : Binding->Type->getFunctionType();
+
+  if (calleeType->getNumParams() != Args.size())
     return ErrorV(this, "Wrong number of arguments to function");
 
+  if (RequireTail && !Tail) return errorNotInTailPosition(this, Callee);
+
+  // an accumulating caller still has to fold its accumulator into whatever
+  // another function returns, so only its self calls can jump
+  bool selfTail = Tail && !Indirect && Binding == TailLoopBinding && TailLoopHeader;
+  bool mustTail = Tail && !selfTail && !TailLoopAccumulator && calleeType == caller->getFunctionType();
+
+  if (RequireTail && !selfTail && !mustTail) {
+    std::string message = "Tail call to ";
+    message += getSymbolName(Callee);
+    message += TailLoopAccumulator ? " can't be honored, the caller accumulates its result"
+                                   : " can't be honored, its type differs from the caller's";
+    return ErrorV(this, message.c_str());
+  }
+
   std::vector<Value*> ArgsV;
   for (unsigned i = 0, e = Args.size(); i < e; i++) {
     ArgsV.push_back(Args[i]->Codegen());
@@ -320,25 +792,85 @@ Value *CallExprAST::Codegen() {
 
   EricDebugInfo.emitLocation(this);
 
-  FunctionTypeData* fnType = FunctionTypeData::getFunctionType(Callee);
-
-  std::string retType = fnType->getReturnType()->getName();
-  //fprintf(stdout, "func call %s returns %s\n", Callee.c_str(), retType.c_str());
+  TypeData *retType = getType();
+  //fprintf(stdout, "func call %s returns %s\n", getSymbolName(Callee).c_str(), retType->getName().c_str());
 
   //for (unsigned i = 0, e = fnType->getNumParameters(); i < e; i++) {
   //  fprintf(stdout, "  p %i type %s\n", i, fnType->getParameterType(i)->getName().c_str());
   //}
 
-  if (retType == "void") {
-    return Builder.CreateCall(CalleeF, ArgsV);
+  if (selfTail) {
+    return emitTailLoop(ArgsV, retType, 0);
+  }
+
+  if (!Indirect) CalleeF = getCallee(Binding);
+
+  // the caller's own body isn't finished, and musttail needs its prototype
+  Function *callee = Indirect ? dyn_cast<Function>(CalleeF) : Binding->Code;
+  if (SpecializationBudget && !Incremental && !mustTail && callee && callee != caller && !callee->empty()) {
+    if (Function *clone = specializeCall(callee, ArgsV)) CalleeF = clone;
+  }
+
+  CallInst *call;
+  if (retType == TypeData::getType(sym_void)) {
+    call = Builder.CreateCall(CalleeF, ArgsV);
+  }
+  else {
+    call = Builder.CreateCall(CalleeF, ArgsV, "calltmp");
+  }
+
+  // nothing lives on our stack, so any call in tail position may reuse it
+  call->setTailCall(Tail);
+
+  if (!mustTail) return call;
+
+  call->setTailCallKind(CallInst::TCK_MustTail);
+
+  if (retType == TypeData::getType(sym_void)) {
+    Builder.CreateRetVoid();
   }
   else {
-    return Builder.CreateCall(CalleeF, ArgsV, "calltmp");
+    Builder.CreateRet(call);
   }
+
+  return continueAfterTailCall(retType);
+}
+
+// the call isn't in tail position, whichever way it is lowered
+Value *CallExprAST::CodegenAccumulated(char op, Value *operand, ExprAST *expression) {
+  if (RequireTail) return errorNotInTailPosition(this, Callee);
+
+  std::vector<Value*> ArgsV;
+  for (unsigned i = 0, e = Args.size(); i < e; i++) {
+    ArgsV.push_back(Args[i]->Codegen());
+    if (!ArgsV.back()) return 0;
+  }
+
+  EricDebugInfo.emitLocation(expression);
+  Value *accumulated = accumulate(op, TailLoopAccumulator, operand);
+
+  EricDebugInfo.emitLocation(this);
+  return emitTailLoop(ArgsV, getType(), accumulated);
+}
+
+// arrays are never written once built, so one with constant elements can
+// live in read-only data, count and all, and be shared by every evaluation
+static Value *createConstantArray(Type *arrayType, uint64_t count, Constant *elements) {
+  Type *integerType = TypeData::getType(sym_integer)->getLLVMType();
+
+  std::vector<Constant *> fields;
+  fields.push_back(ConstantInt::get(integerType, count));
+  fields.push_back(elements);
+  Constant *data = ConstantStruct::getAnon(getGlobalContext(), fields);
+
+  GlobalVariable *global = new GlobalVariable(*TheModule, data->getType(), true, GlobalValue::PrivateLinkage, data, "array");
+  global->setUnnamedAddr(true);
+
+  return ConstantExpr::getBitCast(global, arrayType);
 }
 
 Value *ArrayLiteralExprAST::Codegen() {
-  TypeData *t = Typecheck();
+  TypeData *t = getType();
   if (!t) return 0;
 
   //fprintf(stdout, "genning %s\n", t->getName().c_str());
@@ -370,22 +902,41 @@ Value *ArrayLiteralExprAST::Codegen() {
 
   //fprintf(stdout, "genning\n");
 
-  Type *integerType = TypeData::getType("integer")->getLLVMType();
+  Type *integerType = TypeData::getType(sym_integer)->getLLVMType();
   Type *thirtyTwoBitInteger = TypeBuilder<types::i<32>, true>::get(getGlobalContext());
 
   //fprintf(stdout, "genning\n");
 
+  std::vector<Value *> values;
+  std::vector<Constant *> constants;
+  for (unsigned i = 0, e = Elements.size(); i < e; i++) {
+    Value *el = Elements[i]->Codegen();
+    if (!el) return 0;
+
+    values.push_back(el);
+    if (Constant *c = dyn_cast<Constant>(el)) constants.push_back(c);
+  }
+
+  // all literals, so no need to build it each time
+  if (constants.size() == values.size()) {
+    ArrayType *elementsType = ArrayType::get(elementType, constants.size());
+    return createConstantArray(llvmType, constants.size(), ConstantArray::get(elementsType, constants));
+  }
+
   uint64_t size = DL->getTypeStoreSize(elementType);
   uint64_t count = Elements.size();
   uint64_t overhead = DL->getTypeStoreSize(integerType);
 
   Value *space = ConstantInt::get(integerType, size * count + overhead);
 
-  Function *malloc = TheModule->getFunction("malloc");
+  FunctionBinding *mallocBinding = LookupFunction(sym_malloc);
+  Value *malloc = mallocBinding ? getCallee(mallocBinding) : 0;
   if (!malloc) {
     return ErrorV(this, "no malloc found");
   }
 
+  EricDebugInfo.emitLocation(this);
+
   // malloc the space for the array
   Value *mem = Builder.CreateCall(malloc, space, "malloctmp");
 
@@ -397,38 +948,174 @@ Value *ArrayLiteralExprAST::Codegen() {
   Builder.CreateStore(ConstantInt::get(integerType, count), countPtr);
 
   // insert the values
-  for (unsigned i = 0, e = Elements.size(); i < e; i++) {
-    Value *el = Elements[i]->Codegen();
-    if (!el) return 0;
-
+  for (unsigned i = 0, e = values.size(); i < e; i++) {
     SmallVector<Value *, 8> idxs;
     idxs.push_back(ConstantInt::get(integerType, 0));
     idxs.push_back(ConstantInt::get(thirtyTwoBitInteger, 1));
     idxs.push_back(ConstantInt::get(integerType, i));
 
     Value *elPtr = Builder.CreateGEP(bc, idxs, "arrayindextmp");
-    Builder.CreateStore(el, elPtr);
+    Builder.CreateStore(values[i], elPtr);
   }
 
   return bc;
 }
 
-Value *ArrayReferenceExprAST::Codegen() {
-  TypeData *myType = Typecheck();
+static bool readWholeFile(const std::string &path, std::vector<uint8_t> &contents) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) return false;
 
-  Value *array = Source->Codegen();
-  if (!array) return 0;
+  uint8_t buffer[1 << 16];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents.insert(contents.end(), buffer, buffer + count);
+  }
 
-  Value *index = Index->Codegen();
-  if (!index) return 0;
+  bool failed = ferror(file);
+  fclose(file);
+  return !failed;
+}
+
+Value *EmbedExprAST::Codegen() {
+  TypeData *t = getType();
+  if (!t) return 0;
+
+  std::vector<uint8_t> contents;
+  if (!readWholeFile(getSymbolName(Path), contents)) {
+    std::string message = "Unable to read embedded file ";
+    message += getSymbolName(Path);
+    return ErrorV(this, message.c_str());
+  }
 
+  Constant *data = ConstantDataArray::get(getGlobalContext(), contents);
+  return createConstantArray(t->getLLVMType(), contents.size(), data);
+}
+
+static Value *loadArrayCount(Value *array) {
   Value *countPtr = Builder.CreateConstGEP2_32(array, 0, 0, "arraycountptrtmp");
   Value *count = Builder.CreateLoad(countPtr, "arraycounttmp");
-  Value *legal = Builder.CreateICmpSLT(index, count, "legaltmp");
 
-  // TODO: only continue if legal
+  ArrayCounts[count] = array;
+  return count;
+}
+
+// an array keeps its count in front of the elements, a slice carries its own
+static Value *loadLength(Value *sequence, TypeData *type) {
+  if (!type->isSliceType()) return loadArrayCount(sequence);
+
+  Value *length = Builder.CreateExtractValue(sequence, 2, "slicelengthtmp");
 
-  Type *integerType = TypeData::getType("integer")->getLLVMType();
+  ArrayCounts[length] = sequence;
+  return length;
+}
+
+static bool isNonNegative(Value *v) {
+  ConstantInt *constant = dyn_cast<ConstantInt>(v);
+  if (constant) return constant->getSExtValue() >= 0;
+
+  return std::find(NonNegative.begin(), NonNegative.end(), v) != NonNegative.end();
+}
+
+static bool isKnownInBounds(Value *index, Value *array) {
+  for (unsigned i = 0, e = KnownInBounds.size(); i < e; i++) {
+    if (KnownInBounds[i].Index == index && KnownInBounds[i].Array == array)
+      return true;
+  }
+  return false;
+}
+
+// both sides of an '&' hold when the branch is taken
+static bool isConjunction(Value *condition) {
+  BinaryOperator *op = dyn_cast<BinaryOperator>(condition);
+  return op && op->getOpcode() == Instruction::And;
+}
+
+// '0 < index', '-1 < index' and 'index = 0' keep the index from being
+// negative
+static void learnNonNegative(Value *condition) {
+  if (isConjunction(condition)) {
+    learnNonNegative(cast<BinaryOperator>(condition)->getOperand(0));
+    learnNonNegative(cast<BinaryOperator>(condition)->getOperand(1));
+    return;
+  }
+
+  ICmpInst *compare = dyn_cast<ICmpInst>(condition);
+  if (!compare) return;
+
+  Value *lhs = compare->getOperand(0);
+  Value *rhs = compare->getOperand(1);
+  ConstantInt *bound = dyn_cast<ConstantInt>(lhs);
+
+  switch (compare->getPredicate()) {
+  default: break;
+  case CmpInst::ICMP_SLT:
+    if (isNonNegative(lhs) || (bound && bound->getSExtValue() == -1)) NonNegative.push_back(rhs);
+    break;
+  case CmpInst::ICMP_EQ:
+    if (isNonNegative(lhs)) NonNegative.push_back(rhs);
+    else if (isNonNegative(rhs)) NonNegative.push_back(lhs);
+    break;
+  }
+}
+
+static void learnInBounds(Value *condition) {
+  if (isConjunction(condition)) {
+    learnInBounds(cast<BinaryOperator>(condition)->getOperand(0));
+    learnInBounds(cast<BinaryOperator>(condition)->getOperand(1));
+    return;
+  }
+
+  ICmpInst *compare = dyn_cast<ICmpInst>(condition);
+  if (!compare) return;
+
+  Value *index = compare->getOperand(0);
+  std::map<Value *, Value *>::iterator count = ArrayCounts.find(compare->getOperand(1));
+  if (count == ArrayCounts.end()) return;
+
+  bool inRange = compare->getPredicate() == CmpInst::ICMP_ULT
+    || (compare->getPredicate() == CmpInst::ICMP_SLT && isNonNegative(index));
+
+  if (inRange) {
+    InBounds fact = { index, count->second };
+    KnownInBounds.push_back(fact);
+  }
+}
+
+// a branch on 'index < length(array)' keeps the index in range once it is
+// also known not to be negative, from this condition or a dominating one
+static void learnFromCondition(Value *condition) {
+  learnNonNegative(condition);
+  learnInBounds(condition);
+}
+
+static void emitTrapUnless(Value *legal) {
+  Function *parentFunction = Builder.GetInsertBlock()->getParent();
+  BasicBlock *legalBlock = BasicBlock::Create(getGlobalContext(), "inbounds", parentFunction);
+  BasicBlock *trapBlock = BasicBlock::Create(getGlobalContext(), "outofbounds", parentFunction);
+
+  MDBuilder weights(getGlobalContext());
+  Builder.CreateCondBr(legal, legalBlock, trapBlock, weights.createBranchWeights(1 << 20, 1));
+
+  Builder.SetInsertPoint(trapBlock);
+  Builder.CreateCall(Intrinsic::getDeclaration(TheModule, Intrinsic::trap));
+  Builder.CreateUnreachable();
+
+  Builder.SetInsertPoint(legalBlock);
+}
+
+static void emitBoundsCheck(Value *sequence, TypeData *type, Value *index) {
+  if (isKnownInBounds(index, sequence)) return;
+
+  // unsigned, so negative indices are out of range too
+  Value *count = loadLength(sequence, type);
+  emitTrapUnless(Builder.CreateICmpULT(index, count, "legaltmp"));
+
+  InBounds fact = { index, sequence };
+  KnownInBounds.push_back(fact);
+}
+
+static Value *getElementPointer(Value *array, Value *index) {
+  Type *integerType = TypeData::getType(sym_integer)->getLLVMType();
   Type *thirtyTwoBitInteger = TypeBuilder<types::i<32>, true>::get(getGlobalContext());
 
   SmallVector<Value *, 8> idxs;
@@ -436,12 +1123,79 @@ Value *ArrayReferenceExprAST::Codegen() {
   idxs.push_back(ConstantInt::get(thirtyTwoBitInteger, 1));
   idxs.push_back(index);
 
-  Value *refPtr = Builder.CreateGEP(array, idxs, "arrayindexptrtmp");
+  return Builder.CreateGEP(array, idxs, "arrayindexptrtmp");
+}
+
+Value *ArrayReferenceExprAST::Codegen() {
+  TypeData *sourceType = Source->getType();
+  if (!sourceType) return 0;
+
+  Value *sequence = Source->Codegen();
+  if (!sequence) return 0;
+
+  Value *index = Index->Codegen();
+  if (!index) return 0;
+
+  EricDebugInfo.emitLocation(this);
+
+  if (BoundsChecks) emitBoundsCheck(sequence, sourceType, index);
+
+  // a slice indexes into the array it views
+  Value *array = sequence;
+  if (sourceType->isSliceType()) {
+    array = Builder.CreateExtractValue(sequence, 0, "slicearraytmp");
+    Value *offset = Builder.CreateExtractValue(sequence, 1, "sliceoffsettmp");
+    index = Builder.CreateNSWAdd(offset, index, "sliceindextmp");
+  }
+
+  Value *refPtr = getElementPointer(array, index);
   return Builder.CreateLoad(refPtr, "arrayindextmp");
 }
 
+Value *SliceExprAST::Codegen() {
+  TypeData *sourceType = Source->getType();
+  if (!sourceType) return 0;
+
+  TypeData *sliceType = getType();
+  if (!sliceType) return 0;
+
+  Value *source = Source->Codegen();
+  if (!source) return 0;
+
+  Value *start = Start->Codegen();
+  if (!start) return 0;
+
+  Value *end = End->Codegen();
+  if (!end) return 0;
+
+  EricDebugInfo.emitLocation(this);
+
+  // unsigned, so a negative start or a reversed range is out of range too
+  if (BoundsChecks) {
+    Value *length = loadLength(source, sourceType);
+    Value *ordered = Builder.CreateICmpULE(start, end, "sliceorderedtmp");
+    Value *inside = Builder.CreateICmpULE(end, length, "sliceinsidetmp");
+    emitTrapUnless(Builder.CreateAnd(ordered, inside, "legaltmp"));
+  }
+
+  // a slice of a slice views the same array
+  Value *array = source;
+  Value *offset = start;
+  if (sourceType->isSliceType()) {
+    array = Builder.CreateExtractValue(source, 0, "slicearraytmp");
+    Value *base = Builder.CreateExtractValue(source, 1, "sliceoffsettmp");
+    offset = Builder.CreateNSWAdd(base, start, "sliceoffsettmp");
+  }
+
+  Value *slice = UndefValue::get(sliceType->getLLVMType());
+  slice = Builder.CreateInsertValue(slice, array, 0);
+  slice = Builder.CreateInsertValue(slice, offset, 1);
+  slice = Builder.CreateInsertValue(slice, Builder.CreateNSWSub(end, start, "slicelengthtmp"), 2, "slicetmp");
+  return slice;
+}
+
 Value *ValueLiteralAST::Codegen() {
-  TypeData *myType = Typecheck();
+  TypeData *myType = getType();
   if (!myType) return 0;
 
   Type *myT = myType->getLLVMType();
@@ -465,7 +1219,7 @@ Value *ValueLiteralAST::Codegen() {
 }
 
 Value *ValueReferenceAST::Codegen() {
-  TypeData *td = Source->Typecheck();
+  TypeData *td = Source->getType();
   if (!td) return 0;
 
   if (!td->isStructType()) {
@@ -479,7 +1233,7 @@ Value *ValueReferenceAST::Codegen() {
   int idx = st->getFieldIndex(FieldReference);
   if (-1 == idx) {
     std::string message = "Value has no field named ";
-    message += FieldReference;
+    message += getSymbolName(FieldReference);
     return ErrorV(this, message.c_str());
   }
 
@@ -500,6 +1254,19 @@ Value *BlockExprAST::Codegen() {
   return v;
 }
 
+Value *LetExprAST::Codegen() {
+  llvm::Value *value = Value->Codegen();
+  if (!value) return 0;
+
+  // named after the binding in the IR, arguments keep their own names
+  if (isa<Instruction>(value)) value->setName(getSymbolName(Name));
+
+  if (SlotValues.size() <= Slot) SlotValues.resize(Slot + 1);
+  SlotValues[Slot] = value;
+
+  return UndefValue::get(TypeBuilder<types::i<1>, true>::get(getGlobalContext()));
+}
+
 Value *ConditionalExprAST::Codegen() {
   // blocks
   Function *parentFunction = Builder.GetInsertBlock()->getParent();
@@ -515,13 +1282,19 @@ Value *ConditionalExprAST::Codegen() {
   EricDebugInfo.emitLocation(this);
   Builder.CreateCondBr(conditionValue, consequentBlock, alternateBlock);
 
+  KnownFacts known = rememberFacts();
+
   // emit consequent
   Builder.SetInsertPoint(consequentBlock);
 
+  learnFromCondition(conditionValue);
+
   EricDebugInfo.emitLocation(Consequent);
   Value *consequentResult = Consequent->Codegen();
   if (!consequentResult) return 0;
 
+  forgetFacts(known);
+
   Builder.CreateBr(mergeBlock);
   consequentBlock = Builder.GetInsertBlock(); // in case of nested blocks
 
@@ -533,6 +1306,8 @@ Value *ConditionalExprAST::Codegen() {
   Value *alternateResult = Alternate->Codegen();
   if (!alternateResult) return 0;
 
+  forgetFacts(known);
+
   Builder.CreateBr(mergeBlock);
   alternateBlock = Builder.GetInsertBlock(); // in case of nested blocks
 
@@ -540,11 +1315,11 @@ Value *ConditionalExprAST::Codegen() {
   parentFunction->getBasicBlockList().push_back(mergeBlock);
   Builder.SetInsertPoint(mergeBlock);
 
-  TypeData *mergedType = Typecheck();
+  TypeData *mergedType = getType();
 
   EricDebugInfo.emitLocation(this);
 
-  if (mergedType->getName() == "void") {
+  if (mergedType == TypeData::getType(sym_void)) {
     return UndefValue::get(TypeBuilder<types::i<1>, true>::get(getGlobalContext()));
   }
   else
@@ -556,6 +1331,103 @@ Value *ConditionalExprAST::Codegen() {
   }
 }
 
+Value *WhileExprAST::Codegen() {
+  Function *parentFunction = Builder.GetInsertBlock()->getParent();
+
+  BasicBlock *conditionBlock = BasicBlock::Create(getGlobalContext(), "whilecond", parentFunction);
+  BasicBlock *bodyBlock = BasicBlock::Create(getGlobalContext(), "whilebody");
+  BasicBlock *endBlock = BasicBlock::Create(getGlobalContext(), "whileend");
+
+  EricDebugInfo.emitLocation(this);
+  Builder.CreateBr(conditionBlock);
+
+  // emit condition
+  Builder.SetInsertPoint(conditionBlock);
+
+  Value *conditionValue = Condition->Codegen();
+  if (!conditionValue) return 0;
+
+  EricDebugInfo.emitLocation(this);
+  Builder.CreateCondBr(conditionValue, bodyBlock, endBlock);
+
+  KnownFacts known = rememberFacts();
+
+  // emit body
+  parentFunction->getBasicBlockList().push_back(bodyBlock);
+  Builder.SetInsertPoint(bodyBlock);
+
+  learnFromCondition(conditionValue);
+
+  EricDebugInfo.emitLocation(Body);
+  if (!Body->Codegen()) return 0;
+
+  forgetFacts(known);
+
+  Builder.CreateBr(conditionBlock);
+
+  // emit end
+  parentFunction->getBasicBlockList().push_back(endBlock);
+  Builder.SetInsertPoint(endBlock);
+
+  return UndefValue::get(TypeBuilder<types::i<1>, true>::get(getGlobalContext()));
+}
+
+Value *ForExprAST::Codegen() {
+  Function *parentFunction = Builder.GetInsertBlock()->getParent();
+
+  // the range is evaluated once, up front
+  Value *startValue = Start->Codegen();
+  if (!startValue) return 0;
+
+  Value *endValue = End->Codegen();
+  if (!endValue) return 0;
+
+  BasicBlock *preheaderBlock = Builder.GetInsertBlock();
+  BasicBlock *headerBlock = BasicBlock::Create(getGlobalContext(), "forcond", parentFunction);
+  BasicBlock *bodyBlock = BasicBlock::Create(getGlobalContext(), "forbody");
+  BasicBlock *endBlock = BasicBlock::Create(getGlobalContext(), "forend");
+
+  EricDebugInfo.emitLocation(this);
+  Builder.CreateBr(headerBlock);
+
+  // emit header
+  Builder.SetInsertPoint(headerBlock);
+
+  PHINode *index = Builder.CreatePHI(startValue->getType(), 2, getSymbolName(Name));
+  index->addIncoming(startValue, preheaderBlock);
+
+  Value *inRange = Builder.CreateICmpSLT(index, endValue, "forcmp");
+  Builder.CreateCondBr(inRange, bodyBlock, endBlock);
+
+  // emit body
+  parentFunction->getBasicBlockList().push_back(bodyBlock);
+  Builder.SetInsertPoint(bodyBlock);
+
+  if (SlotValues.size() <= Slot) SlotValues.resize(Slot + 1);
+  SlotValues[Slot] = index;
+
+  KnownFacts known = rememberFacts();
+
+  if (isNonNegative(startValue)) NonNegative.push_back(index);
+  learnFromCondition(inRange);
+
+  EricDebugInfo.emitLocation(Body);
+  if (!Body->Codegen()) return 0;
+
+  forgetFacts(known);
+
+  EricDebugInfo.emitLocation(this);
+  Value *next = Builder.CreateNSWAdd(index, ConstantInt::get(startValue->getType(), 1), "fornext");
+  index->addIncoming(next, Builder.GetInsertBlock());
+  Builder.CreateBr(headerBlock);
+
+  // emit end
+  parentFunction->getBasicBlockList().push_back(endBlock);
+  Builder.SetInsertPoint(endBlock);
+
+  return UndefValue::get(TypeBuilder<types::i<1>, true>::get(getGlobalContext()));
+}
+
 TypeData *ValueTypeAST::MakeType() {
   std::vector<TypeData *> ts;
   for (unsigned i = 0, e = ElementNames.size(); i < e; i++) {
@@ -565,43 +1437,117 @@ TypeData *ValueTypeAST::MakeType() {
     ts.push_back(t);
   }
 
-  TypeData *typeData = new StructTypeData(Name, ts, ElementNames);
+  std::vector<Symbol> names(ElementNames.begin(), ElementNames.end());
+  TypeData *typeData = new StructTypeData(getSymbolName(Name), ts, names);
 
   TypeData::registerType(typeData);
 
   return typeData;
 }
 
+bool ConstantAST::Codegen() {
+  Type *type = Binding->Type->getLLVMType();
+  if (!type) return false;
+
+  // a session refers to it from later modules
+  GlobalValue::LinkageTypes linkage = Incremental ? GlobalValue::ExternalLinkage : GlobalValue::InternalLinkage;
+  std::string name = getSymbolName(Name);
+
+  // only bound once it has a value, so a failed constant leaves nothing
+  // for later references to pick up
+  GlobalVariable *global = new GlobalVariable(*TheModule, type, false, linkage, Constant::getNullValue(type), name + ".constant");
+
+  // folded, so it is only data
+  if (Binding->Literal) {
+    llvm::Value *value = Binding->Literal->Codegen();
+    if (!value) {
+      global->eraseFromParent();
+      return false;
+    }
+
+    if (Constant *c = dyn_cast<Constant>(value)) {
+      global->setInitializer(c);
+      global->setConstant(true);
+      Binding->Global = global;
+      return true;
+    }
+  }
+
+  FunctionType *initType = FunctionType::get(Type::getVoidTy(getGlobalContext()), false);
+  Function *init = Function::Create(initType, linkage, name + ".init", TheModule);
+
+  DISubprogram SP = createGeneratedSubprogram(init);
+  EricDebugInfo.LexicalBlocks.push_back(&SP);
+
+  KnownInBounds.clear();
+  ArrayCounts.clear();
+  NonNegative.clear();
+
+  BasicBlock *BB = BasicBlock::Create(getGlobalContext(), "entry", init);
+  Builder.SetInsertPoint(BB);
+
+  EricDebugInfo.emitLocation(Value);
+  llvm::Value *value = Value->Codegen();
+
+  if (value) {
+    Builder.CreateStore(value, global);
+    Builder.CreateRetVoid();
+  }
+
+  EricDebugInfo.LexicalBlocks.pop_back();
+
+  if (!value) {
+    init->eraseFromParent();
+    global->eraseFromParent();
+    return false;
+  }
+
+  verifyFunction(*init);
+
+  Binding->Global = global;
+  Initializer = init;
+  if (!Incremental) ConstantInitializers.push_back(init);
+
+  return true;
+}
+
 Function *PrototypeAST::Codegen() {
-  TypeData *t = Typecheck();
+  FunctionTypeData *t = Typecheck();
   if (!t) return 0;
 
-  FunctionType *FT = (FunctionType *)t->getLLVMType();
-  Function *F = Function::Create(FT, Function::ExternalLinkage, Name, TheModule);
+  FunctionType *FT = t->getFunctionType();
+  std::string FnName = getSymbolName(Name);
+
+  // the JIT finds session code by name
+  if (Incremental && Name == sym_empty) {
+    FnName = "expr." + std::to_string(++SessionVersions);
+  }
+
+  Function *F = Function::Create(FT, Function::ExternalLinkage, FnName, TheModule);
 
-  if (F->getName() != Name) {
+  if (F->getName() != FnName) {
     F->eraseFromParent();
-    F = TheModule->getFunction(Name);
+    F = TheModule->getFunction(FnName);
 
     if (!F->empty()) {
       std::string message = "redefinition of function: ";
-      message += Name;
+      message += FnName;
       return ErrorF2(Location, message.c_str());
     }
 
     if (F->arg_size() != ArgTypes.size()) {
       std::string message = "implementation of function has wrong arguments: ";
-      message += Name;
+      message += FnName;
       return ErrorF2(Location, message.c_str());
     }
   }
 
-  DICompositeType debugType = (DICompositeType)t->getDIType(EricDebugInfo.DebugContext);
+  DICompositeType debugType = (DICompositeType)t->getSubroutineDIType(EricDebugInfo.DebugContext);
 
   DIDescriptor fContext(EricDebugInfo.Unit);
   DISubprogram SP = DBuilder->createFunction(
     fContext,                                   // file
-    Name,                                       // name
+    FnName,                                     // name
     "",                                         // ??
     EricDebugInfo.Unit,                         // file
     Location.Line,                              // line number
@@ -616,15 +1562,22 @@ Function *PrototypeAST::Codegen() {
 
   EricDebugInfo.FnScopeMap[this] = SP;
 
+  Binding->Code = F;
+
+  if (Pure) {
+    F->addFnAttr(Attribute::ReadNone);
+    F->addFnAttr(Attribute::NoUnwind);
+  }
+
   return F;
 }
 
 void PrototypeAST::UpdateArguments(Function *F) {
   unsigned Idx = 0;
   for (Function::arg_iterator AI = F->arg_begin(); Idx != ArgTypes.size(); ++AI, ++Idx) {
-    AI->setName(ArgNames[Idx]);
+    AI->setName(getSymbolName(ArgNames[Idx]));
 
-    NamedValues[ArgNames[Idx]] = AI;
+    SlotValues[Idx] = AI;
 
     TypeData *argType = TypeData::getType(ArgTypes[Idx]);
     if (!argType) fprintf(stderr, "Error retrieving argument type.\n");
@@ -633,24 +1586,196 @@ void PrototypeAST::UpdateArguments(Function *F) {
     DIVariable D = DBuilder->createLocalVariable(
       dwarf::DW_TAG_arg_variable,
       *Scope,
-      ArgNames[Idx],
+      getSymbolName(ArgNames[Idx]),
       EricDebugInfo.Unit,
       Location.Line,
       argType->getDIType(EricDebugInfo.DebugContext),
       Idx
     );
 
+    // the declare intrinsic belongs to the first module
+    if (Incremental) continue;
+
     llvm::Instruction *Call = DBuilder->insertDeclare(AI, D, Builder.GetInsertBlock());
     Call->setDebugLoc(DebugLoc::get(Location.Line, Location.Column, *Scope));
   }
 }
 
+// The first definition of a function in a session keeps its name and
+// publishes it through an entry pointer, later ones get a fresh name and
+// replace the entry once compiled.
+static void publishSessionFunction(FunctionBinding *binding, Function *F) {
+  if (binding->Name == sym_empty) return;
+
+  if (!binding->Entry) {
+    binding->Entry = new GlobalVariable(
+      *TheModule,
+      F->getType(),
+      false,
+      GlobalValue::ExternalLinkage,
+      F,
+      F->getName().str() + ".entry"
+    );
+    return;
+  }
+
+  F->setName(getSymbolName(binding->Name) + "." + std::to_string(++SessionVersions));
+}
+
+// memo tables
+//
+// A memo function is compiled as usual under a .uncached name, and callers
+// get a function that first looks the arguments up in a table of entries
+// {full, arguments..., result}.  An entry's slot is picked by a hash of the
+// argument bits, so numbers match exactly as stored.
+
+static Value *getKeyBits(Value *v) {
+  Type *integerType = TypeData::getType(sym_integer)->getLLVMType();
+  if (v->getType() == TypeData::getType(sym_number)->getLLVMType()) return Builder.CreateBitCast(v, integerType);
+  return Builder.CreateZExt(v, integerType);
+}
+
+static Function *createMemoFunction(Function *uncached, unsigned capacity, MemoEviction eviction) {
+  Type *integerType = TypeData::getType(sym_integer)->getLLVMType();
+  Type *booleanType = TypeData::getType(sym_boolean)->getLLVMType();
+
+  std::string name = uncached->getName().str();
+  uncached->setName(name + ".uncached");
+  uncached->setLinkage(GlobalValue::InternalLinkage);
+
+  Function *F = Function::Create(uncached->getFunctionType(), Function::ExternalLinkage, name, TheModule);
+  F->addFnAttr(Attribute::NoUnwind);
+
+  // recursive calls go through the table too, debug info keeps the body
+  while (!uncached->use_empty()) uncached->use_begin()->set(F);
+
+  unsigned bits = 0;
+  while ((1u << bits) < capacity) bits++;
+
+  std::vector<Type *> fields;
+  fields.push_back(booleanType);
+  for (Function::arg_iterator AI = F->arg_begin(), AE = F->arg_end(); AI != AE; ++AI) {
+    fields.push_back(AI->getType());
+  }
+  fields.push_back(F->getReturnType());
+
+  StructType *entryType = StructType::get(getGlobalContext(), fields);
+  ArrayType *tableType = ArrayType::get(entryType, 1u << bits);
+  GlobalVariable *table = new GlobalVariable(*TheModule, tableType, false, GlobalValue::InternalLinkage,
+                                             ConstantAggregateZero::get(tableType), name + ".memo");
+
+  DISubprogram SP = createGeneratedSubprogram(F);
+  EricDebugInfo.LexicalBlocks.push_back(&SP);
+  EricDebugInfo.clearLocation();
+
+  BasicBlock *entry = BasicBlock::Create(getGlobalContext(), "entry", F);
+  BasicBlock *hit = BasicBlock::Create(getGlobalContext(), "hit", F);
+  BasicBlock *miss = BasicBlock::Create(getGlobalContext(), "miss", F);
+  Builder.SetInsertPoint(entry);
+  EricDebugInfo.emitLocation(0, 0);
+
+  // fibonacci hashing, the top bits of the product pick the slot
+  std::vector<Value *> args;
+  Value *hash = ConstantInt::get(integerType, 0);
+  for (Function::arg_iterator AI = F->arg_begin(), AE = F->arg_end(); AI != AE; ++AI) {
+    args.push_back(AI);
+    hash = Builder.CreateXor(hash, getKeyBits(AI));
+    hash = Builder.CreateMul(hash, ConstantInt::get(integerType, 0x9E3779B97F4A7C15ULL));
+  }
+  Value *index = bits ? Builder.CreateLShr(hash, 64 - bits) : ConstantInt::get(integerType, 0);
+
+  SmallVector<Value *, 2> idxs;
+  idxs.push_back(ConstantInt::get(integerType, 0));
+  idxs.push_back(index);
+  Value *slot = Builder.CreateInBoundsGEP(table, idxs, "slot");
+  Value *cached = Builder.CreateLoad(slot, "cached");
+
+  Value *full = Builder.CreateExtractValue(cached, 0, "full");
+  Value *matched = full;
+  for (unsigned i = 0, e = args.size(); i < e; i++) {
+    Value *key = Builder.CreateExtractValue(cached, i + 1);
+    matched = Builder.CreateAnd(matched, Builder.CreateICmpEQ(getKeyBits(key), getKeyBits(args[i])));
+  }
+  Builder.CreateCondBr(matched, hit, miss);
+
+  Builder.SetInsertPoint(hit);
+  Builder.CreateRet(Builder.CreateExtractValue(cached, args.size() + 1));
+
+  Builder.SetInsertPoint(miss);
+  Value *result = Builder.CreateCall(uncached, args, "result");
+
+  // the entry is stored whole, so it is never seen half written
+  BasicBlock *done = 0;
+  if (eviction == evict_keep) {
+    BasicBlock *store = BasicBlock::Create(getGlobalContext(), "store", F);
+    done = BasicBlock::Create(getGlobalContext(), "done", F);
+    Builder.CreateCondBr(full, done, store);
+    Builder.SetInsertPoint(store);
+  }
+
+  Value *fresh = Builder.CreateInsertValue(UndefValue::get(entryType), ConstantInt::get(booleanType, 1), 0);
+  for (unsigned i = 0, e = args.size(); i < e; i++) {
+    fresh = Builder.CreateInsertValue(fresh, args[i], i + 1);
+  }
+  fresh = Builder.CreateInsertValue(fresh, result, args.size() + 1);
+  Builder.CreateStore(fresh, slot);
+
+  if (done) {
+    Builder.CreateBr(done);
+    Builder.SetInsertPoint(done);
+  }
+  Builder.CreateRet(result);
+
+  EricDebugInfo.LexicalBlocks.pop_back();
+
+  verifyFunction(*F);
+
+  return F;
+}
+
 Function *FunctionAST::Codegen() {
-  NamedValues.clear();
+  SlotValues.assign(NumSlots, 0);
+
+  KnownInBounds.clear();
+  ArrayCounts.clear();
+  NonNegative.clear();
+
+  FunctionBinding *binding = Proto->getBinding();
+  Function *previous = binding->Code;
+  GlobalVariable *previousEntry = binding->Entry;
+
+  // calls are only evaluated against a definition that compiled, see Fold
+  FunctionAST *definition = binding->Definition;
+  binding->Definition = 0;
+
+  Effect effect = InferEffect();
+
+  // a memo table would keep results from a callee's old definition
+  if (MemoCapacity) {
+    std::string message;
+    if (Incremental) message = "Memo functions can't be defined in a session: ";
+    else if (effect == effect_any) message = "Memo function must be pure: ";
+
+    if (!message.empty()) {
+      message += getSymbolName(Proto->getName());
+      return ErrorF2(Proto->getLocation(), message.c_str());
+    }
+
+    effect = binding->Effects = effect_caches;
+  }
 
   Function *TheFunction = Proto->Codegen();
   if (!TheFunction) return 0;
 
+  if (Incremental) publishSessionFunction(binding, TheFunction);
+
+  // nothing in Eric unwinds
+  TheFunction->addFnAttr(Attribute::NoUnwind);
+
+  // a session can redefine a callee, so its current effect can't be relied on
+  if (!Incremental && effect == effect_none) TheFunction->addFnAttr(Attribute::ReadNone);
+  if (!Incremental && effect == effect_reads) TheFunction->addFnAttr(Attribute::ReadOnly);
+
   EricDebugInfo.LexicalBlocks.push_back(&EricDebugInfo.FnScopeMap[Proto]);
   EricDebugInfo.clearLocation();
 
@@ -659,16 +1784,67 @@ Function *FunctionAST::Codegen() {
 
   Proto->UpdateArguments(TheFunction);
 
+  Type *returnType = TheFunction->getReturnType();
+  // only where the operator is valid for the type, '+' and '*' on integers
+  // and '&' and '|' on booleans, so the program is the same at -O0
+  bool accumulating = false;
+  if (AccumulatorOp && OptLevel > 0 && returnType->isIntegerTy()) {
+    bool boolean = returnType->isIntegerTy(1);
+    bool logical = AccumulatorOp == '&' || AccumulatorOp == '|';
+    accumulating = boolean == logical;
+  }
+
+  TailLoopBinding = binding;
+  TailLoopHeader = 0;
+  TailLoopAccumulator = 0;
+  if (SelfTailCalls || accumulating) {
+    BasicBlock *entry = Builder.GetInsertBlock();
+    TailLoopHeader = BasicBlock::Create(getGlobalContext(), "tailrecurse", TheFunction);
+    Builder.CreateBr(TailLoopHeader);
+    Builder.SetInsertPoint(TailLoopHeader);
+
+    // the arguments become loop variables
+    TailLoopArguments.clear();
+    for (unsigned i = 0, e = TheFunction->arg_size(); i < e; i++) {
+      PHINode *phi = Builder.CreatePHI(SlotValues[i]->getType(), 2, SlotValues[i]->getName());
+      phi->addIncoming(SlotValues[i], entry);
+      SlotValues[i] = phi;
+      TailLoopArguments.push_back(phi);
+    }
+
+    if (accumulating) {
+      TailLoopOperator = AccumulatorOp;
+      TailLoopAccumulator = Builder.CreatePHI(returnType, 2, "accumulator");
+      TailLoopAccumulator->addIncoming(accumulatorIdentity(AccumulatorOp, returnType), entry);
+    }
+  }
+
   EricDebugInfo.emitLocation(Body);
 
   Value *RetVal = Body->Codegen();
+
+  // the base cases fold in everything accumulated on the way down
+  if (RetVal && TailLoopAccumulator) {
+    RetVal = accumulate(TailLoopOperator, TailLoopAccumulator, RetVal);
+  }
+
+  TailLoopBinding = 0;
+  TailLoopHeader = 0;
+  TailLoopAccumulator = 0;
+
   if (!RetVal) {
+    if (binding->Entry != previousEntry) {
+      binding->Entry->eraseFromParent();
+      binding->Entry = previousEntry;
+    }
+
     TheFunction->eraseFromParent();
+    binding->Code = previous == TheFunction ? 0 : previous;
     EricDebugInfo.LexicalBlocks.pop_back();
     return 0;
   }
 
-  if (Proto->Typecheck()->getReturnType()->getName() == "void") {
+  if (Proto->Typecheck()->getReturnType() == TypeData::getType(sym_void)) {
     Builder.CreateRetVoid();
   }
   else {
@@ -679,5 +1855,11 @@ Function *FunctionAST::Codegen() {
 
   verifyFunction(*TheFunction);
 
+  if (MemoCapacity) {
+    TheFunction = createMemoFunction(TheFunction, MemoCapacity, Eviction);
+    binding->Code = TheFunction;
+  }
+
+  binding->Definition = definition;
   return TheFunction;
 }
@@ -0,0 +1,120 @@
+// emit
+
+#include <cstdio>
+#include <string>
+
+#include "emit.h"
+
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/Module.h"
+#include "llvm/PassManager.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+
+using namespace llvm;
+
+static TargetMachine *Machine = 0;
+
+CodeGenOpt::Level getCodeGenOptLevel(unsigned optLevel) {
+  switch (optLevel) {
+  case 0:  return CodeGenOpt::None;
+  case 1:  return CodeGenOpt::Less;
+  case 2:  return CodeGenOpt::Default;
+  default: return CodeGenOpt::Aggressive;
+  }
+}
+
+bool InitializeTarget(unsigned optLevel) {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+  InitializeNativeTargetAsmParser();
+
+  std::string triple = sys::getDefaultTargetTriple();
+
+  std::string error;
+  const Target *target = TargetRegistry::lookupTarget(triple, error);
+  if (!target) {
+    fprintf(stderr, "Error initializing target %s: %s\n", triple.c_str(), error.c_str());
+    return false;
+  }
+
+  TargetOptions options;
+  Machine = target->createTargetMachine(
+    triple,
+    sys::getHostCPUName(),
+    "",
+    options,
+    Reloc::Default,
+    CodeModel::Default,
+    getCodeGenOptLevel(optLevel)
+  );
+
+  if (!Machine) {
+    fprintf(stderr, "Error creating target machine for %s\n", triple.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+void ConfigureModuleForTarget(Module *module) {
+  if (!Machine) return;
+
+  module->setTargetTriple(Machine->getTargetTriple());
+  module->setDataLayout(Machine->getDataLayout());
+}
+
+static bool emitMachineCode(Module *module, raw_fd_ostream &out, OutputKind kind) {
+  if (!Machine) {
+    fprintf(stderr, "Error: no target machine to emit code for\n");
+    return false;
+  }
+
+  TargetMachine::CodeGenFileType fileType =
+    kind == output_assembly ? TargetMachine::CGFT_AssemblyFile : TargetMachine::CGFT_ObjectFile;
+
+  PassManager passes;
+  passes.add(new DataLayoutPass(module));
+
+  formatted_raw_ostream formatted(out);
+  if (Machine->addPassesToEmitFile(passes, formatted, fileType)) {
+    fprintf(stderr, "Error: target can't emit a file of this type\n");
+    return false;
+  }
+
+  passes.run(*module);
+  return true;
+}
+
+bool EmitToFile(Module *module, const char *filename, OutputKind kind) {
+  std::string error;
+  bool text = kind == output_ir || kind == output_assembly;
+  raw_fd_ostream out(filename, error, text ? sys::fs::F_Text : sys::fs::F_None);
+
+  if (!error.empty()) {
+    fprintf(stderr, "Error opening output file %s: %s\n", filename, error.c_str());
+    return false;
+  }
+
+  switch (kind) {
+  case output_ir:
+    module->print(out, 0);
+    return true;
+
+  case output_bitcode:
+    WriteBitcodeToFile(module, out);
+    return true;
+
+  case output_assembly:
+  case output_object:
+    return emitMachineCode(module, out, kind);
+  }
+
+  return false;
+}
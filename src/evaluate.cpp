@@ -0,0 +1,524 @@
+// compile-time evaluation
+//
+// Once its operands have folded to literals an expression is evaluated
+// over the typed AST and replaced by a literal of its value.  A call to a
+// defined function is evaluated by interpreting the function's folded body,
+// so anything that reaches an external function, depends on a run-time
+// value or runs out of fuel is simply left for run time.
+
+#include <cmath>
+#include <cstdio>
+
+#include "ast.h"
+#include "evaluate.h"
+#include "resolve.h"
+
+static bool Redefinable = false;
+
+// every folded expression gets the same budget
+static const unsigned FuelPerFold = 100000;
+static const unsigned MaxCallDepth = 256;
+
+static unsigned Fuel = 0;
+static unsigned CallDepth = 0;
+
+// the slots of the function being evaluated, none outside of a call
+static std::vector<EvalValue> *Frame = 0;
+
+void InitializeEvaluator(bool redefinable) {
+  Redefinable = redefinable;
+}
+
+static bool evaluate(ExprAST *e, EvalValue &result) {
+  if (Fuel == 0) return false;
+  Fuel--;
+
+  return e->Evaluate(result);
+}
+
+static bool makeScalar(EvalValue &result, Symbol type, int64_t integer, double number) {
+  result = EvalValue();
+  result.Type = TypeData::getType(type);
+  result.Integer = integer;
+  result.Number = number;
+  return true;
+}
+
+static bool makeVoid(EvalValue &result) {
+  return makeScalar(result, sym_void, 0, 0);
+}
+
+static ExprAST *makeLiteral(const EvalValue &value, SourceLocation loc) {
+  TypeData *t = value.Type;
+
+  if (t == TypeData::getType(sym_boolean)) return new BooleanExprAST(loc, value.Integer != 0);
+  if (t == TypeData::getType(sym_integer)) return new IntegerExprAST(loc, value.Integer);
+  if (t == TypeData::getType(sym_number))  return new NumberExprAST(loc, value.Number);
+
+  if (!t->isArrayType() && !t->isStructType()) return 0;
+
+  // an empty array literal has no element type to give it
+  if (t->isArrayType() && value.Elements.empty()) return 0;
+
+  std::vector<ExprAST *> elements;
+  for (unsigned i = 0, e = value.Elements.size(); i < e; i++) {
+    elements.push_back(makeLiteral(value.Elements[i], loc));
+    if (!elements.back()) return 0;
+  }
+
+  if (t->isArrayType()) return new ArrayLiteralExprAST(loc, elements);
+
+  return new ValueLiteralAST(loc, internSymbol(t->getName()), elements);
+}
+
+// replaces an expression whose operands are literals with its value
+static ExprAST *foldIfConstant(ExprAST *e) {
+  Fuel = FuelPerFold;
+  CallDepth = 0;
+  Frame = 0;
+
+  EvalValue value;
+  if (!evaluate(e, value)) return e;
+
+  ExprAST *literal = makeLiteral(value, e->getLocation());
+  if (!literal || literal->Typecheck() != e->getType()) return e;
+
+  return literal;
+}
+
+// the same conversions as the casts in types.cpp
+static bool convert(const EvalValue &value, TypeData *target, EvalValue &result) {
+  TypeData *booleanType = TypeData::getType(sym_boolean);
+  TypeData *integerType = TypeData::getType(sym_integer);
+  TypeData *numberType = TypeData::getType(sym_number);
+
+  if (value.Type == target) {
+    result = value;
+    return true;
+  }
+
+  if (target == booleanType) {
+    // truncated, and unordered or not equal to zero
+    if (value.Type == integerType) return makeScalar(result, sym_boolean, value.Integer & 1, 0);
+    if (value.Type == numberType)  return makeScalar(result, sym_boolean, !(value.Number == 0), 0);
+  }
+  else if (target == integerType) {
+    if (value.Type == booleanType) return makeScalar(result, sym_integer, value.Integer, 0);
+
+    // out of range is undefined at run time, so it is left there
+    if (value.Type == numberType) {
+      if (!(value.Number >= -9223372036854775808.0 && value.Number < 9223372036854775808.0))
+        return false;
+      return makeScalar(result, sym_integer, (int64_t)value.Number, 0);
+    }
+  }
+  else if (target == numberType) {
+    if (value.Type == booleanType || value.Type == integerType)
+      return makeScalar(result, sym_number, 0, (double)value.Integer);
+  }
+
+  return false;
+}
+
+// literals
+
+bool BooleanExprAST::Evaluate(EvalValue &result) {
+  return makeScalar(result, sym_boolean, Val, 0);
+}
+
+bool IntegerExprAST::Evaluate(EvalValue &result) {
+  return makeScalar(result, sym_integer, Val, 0);
+}
+
+bool NumberExprAST::Evaluate(EvalValue &result) {
+  return makeScalar(result, sym_number, 0, Val);
+}
+
+bool ArrayLiteralExprAST::isLiteral() const {
+  for (unsigned i = 0, e = Elements.size(); i < e; i++) {
+    if (!Elements[i]->isLiteral()) return false;
+  }
+  return true;
+}
+
+bool VariableExprAST::isLiteral() const {
+  return Binding && Binding->Literal;
+}
+
+bool ValueLiteralAST::isLiteral() const {
+  for (unsigned i = 0, e = Fields.size(); i < e; i++) {
+    if (!Fields[i]->isLiteral()) return false;
+  }
+  return true;
+}
+
+// expressions
+
+bool VariableExprAST::Evaluate(EvalValue &result) {
+  if (Binding) return Binding->Literal && evaluate(Binding->Literal, result);
+  if (FunctionRef) return false;
+
+  if (!Frame || Slot >= Frame->size() || !(*Frame)[Slot].Type) return false;
+
+  result = (*Frame)[Slot];
+  return true;
+}
+
+// the same operations BinaryExprAST::Codegen emits, anything it would
+// trap or leave undefined on isn't evaluated
+bool BinaryExprAST::Evaluate(EvalValue &result) {
+  EvalValue L, R;
+  if (!evaluate(LHS, L) || !evaluate(RHS, R)) return false;
+
+  TypeData *booleanType = TypeData::getType(sym_boolean);
+  TypeData *integerType = TypeData::getType(sym_integer);
+  TypeData *numberType = TypeData::getType(sym_number);
+  TypeData *T = getType();
+
+  if (T == booleanType) {
+    switch (Op) {
+    case '<':
+      if (L.Type == numberType)  return makeScalar(result, sym_boolean, !(L.Number >= R.Number), 0);
+      if (L.Type == integerType) return makeScalar(result, sym_boolean, L.Integer < R.Integer, 0);
+      break;
+    case '=':
+      if (L.Type == numberType)
+        return makeScalar(result, sym_boolean, L.Number == R.Number || std::isnan(L.Number) || std::isnan(R.Number), 0);
+      if (L.Type == integerType || L.Type == booleanType)
+        return makeScalar(result, sym_boolean, L.Integer == R.Integer, 0);
+      break;
+    case '&':
+      if (L.Type == booleanType) return makeScalar(result, sym_boolean, L.Integer & R.Integer, 0);
+      break;
+    case '|':
+      if (L.Type == booleanType) return makeScalar(result, sym_boolean, L.Integer | R.Integer, 0);
+      break;
+    }
+  }
+  else if (T == numberType) {
+    switch (Op) {
+    case '+': return makeScalar(result, sym_number, 0, L.Number + R.Number);
+    case '-': return makeScalar(result, sym_number, 0, L.Number - R.Number);
+    case '*': return makeScalar(result, sym_number, 0, L.Number * R.Number);
+    case '/': return makeScalar(result, sym_number, 0, L.Number / R.Number);
+    case '%': return makeScalar(result, sym_number, 0, fmod(L.Number, R.Number));
+    }
+  }
+  else if (T == integerType) {
+    // wrapping, as the IR does
+    uint64_t l = L.Integer, r = R.Integer;
+
+    switch (Op) {
+    case '+': return makeScalar(result, sym_integer, (int64_t)(l + r), 0);
+    case '-': return makeScalar(result, sym_integer, (int64_t)(l - r), 0);
+    case '*': return makeScalar(result, sym_integer, (int64_t)(l * r), 0);
+    case '/':
+    case '%':
+      if (R.Integer == 0 || (R.Integer == -1 && L.Integer == INT64_MIN)) return false;
+      return makeScalar(result, sym_integer, Op == '/' ? L.Integer / R.Integer : L.Integer % R.Integer, 0);
+    }
+  }
+
+  return false;
+}
+
+bool CallExprAST::Evaluate(EvalValue &result) {
+  std::vector<EvalValue> arguments(Args.size());
+  for (unsigned i = 0, e = Args.size(); i < e; i++) {
+    if (!evaluate(Args[i], arguments[i])) return false;
+  }
+
+  if (isCast()) return convert(arguments[0], TypeData::getType(Callee), result);
+
+  if (isLength()) {
+    if (!arguments[0].Type->isArrayType()) return false;
+    return makeScalar(result, sym_integer, arguments[0].Elements.size(), 0);
+  }
+
+  FunctionAST *definition = Binding ? Binding->Definition : 0;
+  if (Redefinable || !definition || CallDepth >= MaxCallDepth) return false;
+
+  CallDepth++;
+  bool evaluated = definition->Evaluate(arguments, result);
+  CallDepth--;
+
+  return evaluated;
+}
+
+bool ArrayLiteralExprAST::Evaluate(EvalValue &result) {
+  TypeData *t = getType();
+  if (!t || ((ArrayTypeData *)t)->isEmptyArray()) return false;
+
+  result = EvalValue();
+  result.Type = t;
+  result.Elements.resize(Elements.size());
+
+  for (unsigned i = 0, e = Elements.size(); i < e; i++) {
+    if (!evaluate(Elements[i], result.Elements[i])) return false;
+  }
+  return true;
+}
+
+// out of range is left to trap, or not, at run time
+bool ArrayReferenceExprAST::Evaluate(EvalValue &result) {
+  EvalValue source, index;
+  if (!evaluate(Source, source) || !evaluate(Index, index)) return false;
+
+  if (!source.Type->isArrayType()) return false;
+  if (index.Integer < 0 || (uint64_t)index.Integer >= source.Elements.size()) return false;
+
+  result = source.Elements[index.Integer];
+  return true;
+}
+
+bool ValueLiteralAST::Evaluate(EvalValue &result) {
+  TypeData *t = getType();
+  if (!t) return false;
+
+  result = EvalValue();
+  result.Type = t;
+  result.Elements.resize(Fields.size());
+
+  for (unsigned i = 0, e = Fields.size(); i < e; i++) {
+    if (!evaluate(Fields[i], result.Elements[i])) return false;
+  }
+  return true;
+}
+
+bool ValueReferenceAST::Evaluate(EvalValue &result) {
+  EvalValue source;
+  if (!evaluate(Source, source)) return false;
+
+  if (!source.Type->isStructType()) return false;
+
+  int idx = ((StructTypeData *)source.Type)->getFieldIndex(FieldReference);
+  if (idx < 0) return false;
+
+  result = source.Elements[idx];
+  return true;
+}
+
+bool BlockExprAST::Evaluate(EvalValue &result) {
+  if (Statements.size() == 0) return false;
+
+  for (unsigned i = 0, e = Statements.size(); i < e; i++) {
+    if (!evaluate(Statements[i], result)) return false;
+  }
+  return true;
+}
+
+bool LetExprAST::Evaluate(EvalValue &result) {
+  if (!Frame) return false;
+
+  EvalValue value;
+  if (!evaluate(Value, value)) return false;
+
+  if (Frame->size() <= Slot) Frame->resize(Slot + 1);
+  (*Frame)[Slot] = value;
+
+  return makeVoid(result);
+}
+
+bool ConditionalExprAST::Evaluate(EvalValue &result) {
+  EvalValue condition;
+  if (!evaluate(Condition, condition)) return false;
+
+  return evaluate(condition.Integer ? Consequent : Alternate, result);
+}
+
+bool WhileExprAST::Evaluate(EvalValue &result) {
+  while (true) {
+    EvalValue condition;
+    if (!evaluate(Condition, condition)) return false;
+    if (!condition.Integer) break;
+
+    EvalValue body;
+    if (!evaluate(Body, body)) return false;
+  }
+
+  return makeVoid(result);
+}
+
+bool ForExprAST::Evaluate(EvalValue &result) {
+  if (!Frame) return false;
+
+  EvalValue start, end;
+  if (!evaluate(Start, start) || !evaluate(End, end)) return false;
+
+  if (Frame->size() <= Slot) Frame->resize(Slot + 1);
+
+  for (int64_t i = start.Integer; i < end.Integer; i++) {
+    makeScalar((*Frame)[Slot], sym_integer, i, 0);
+
+    EvalValue body;
+    if (!evaluate(Body, body)) return false;
+  }
+
+  return makeVoid(result);
+}
+
+// folding
+//
+// Children are folded first, so a node only needs evaluating once all of
+// its operands are literals.
+
+// a constant's name becomes its value, unless that would copy an aggregate
+ExprAST *VariableExprAST::Fold() {
+  if (!Binding || !Binding->Literal) return this;
+
+  TypeData *t = Binding->Literal->getType();
+  if (t->isArrayType() || t->isStructType()) return this;
+
+  return Binding->Literal;
+}
+
+ExprAST *BinaryExprAST::Fold() {
+  ExprAST *lhs = LHS->Fold();
+  ExprAST *rhs = RHS->Fold();
+
+  // keep the accumulator operand pointing into the tree
+  if (Operand == LHS) Operand = lhs;
+  if (Operand == RHS) Operand = rhs;
+
+  LHS = lhs;
+  RHS = rhs;
+
+  if (SelfCall || !LHS->isLiteral() || !RHS->isLiteral()) return this;
+
+  return foldIfConstant(this);
+}
+
+ExprAST *CallExprAST::Fold() {
+  bool literals = true;
+  for (unsigned i = 0, e = Args.size(); i < e; i++) {
+    Args[i] = Args[i]->Fold();
+    literals = literals && Args[i]->isLiteral();
+  }
+
+  return literals ? foldIfConstant(this) : this;
+}
+
+ExprAST *ArrayLiteralExprAST::Fold() {
+  for (unsigned i = 0, e = Elements.size(); i < e; i++) {
+    Elements[i] = Elements[i]->Fold();
+  }
+  return this;
+}
+
+ExprAST *ArrayReferenceExprAST::Fold() {
+  Source = Source->Fold();
+  Index = Index->Fold();
+
+  if (!Source->isLiteral() || !Index->isLiteral()) return this;
+
+  return foldIfConstant(this);
+}
+
+ExprAST *SliceExprAST::Fold() {
+  Source = Source->Fold();
+  Start = Start->Fold();
+  End = End->Fold();
+  return this;
+}
+
+ExprAST *ValueLiteralAST::Fold() {
+  for (unsigned i = 0, e = Fields.size(); i < e; i++) {
+    Fields[i] = Fields[i]->Fold();
+  }
+  return this;
+}
+
+ExprAST *ValueReferenceAST::Fold() {
+  Source = Source->Fold();
+
+  if (!Source->isLiteral()) return this;
+
+  return foldIfConstant(this);
+}
+
+ExprAST *BlockExprAST::Fold() {
+  for (unsigned i = 0, e = Statements.size(); i < e; i++) {
+    Statements[i] = Statements[i]->Fold();
+  }
+
+  if (Statements.size() == 1 && Statements[0]->isLiteral()) return Statements[0];
+
+  return this;
+}
+
+ExprAST *LetExprAST::Fold() {
+  Value = Value->Fold();
+  return this;
+}
+
+// a literal condition leaves only the branch taken
+ExprAST *ConditionalExprAST::Fold() {
+  Condition = Condition->Fold();
+  Consequent = Consequent->Fold();
+  Alternate = Alternate->Fold();
+
+  if (!Condition->isLiteral()) return this;
+
+  Fuel = FuelPerFold;
+  Frame = 0;
+
+  EvalValue condition;
+  if (!evaluate(Condition, condition)) return this;
+
+  return condition.Integer ? Consequent : Alternate;
+}
+
+ExprAST *WhileExprAST::Fold() {
+  Condition = Condition->Fold();
+  Body = Body->Fold();
+  return this;
+}
+
+ExprAST *ForExprAST::Fold() {
+  Start = Start->Fold();
+  End = End->Fold();
+  Body = Body->Fold();
+  return this;
+}
+
+// declarations
+
+void ConstantAST::Fold() {
+  Value = Value->Fold();
+
+  // evaluated into a literal of its own, even if it names another constant
+  if (Value->isLiteral()) Value = foldIfConstant(Value);
+
+  Binding->Literal = Value->isLiteral() ? Value : 0;
+}
+
+void FunctionAST::Fold() {
+  FunctionBinding *binding = Proto->getBinding();
+
+  // not evaluated while its own body is still being folded
+  binding->Definition = 0;
+  Body = Body->Fold();
+
+  // dropped again if the definition doesn't compile, see Codegen
+  if (!Redefinable) binding->Definition = this;
+}
+
+bool FunctionAST::Evaluate(std::vector<EvalValue> &arguments, EvalValue &result) {
+  std::vector<EvalValue> frame(NumSlots > arguments.size() ? NumSlots : arguments.size());
+  for (unsigned i = 0, e = arguments.size(); i < e; i++) {
+    frame[i] = arguments[i];
+  }
+
+  std::vector<EvalValue> *caller = Frame;
+  Frame = &frame;
+  bool evaluated = evaluate(Body, result);
+  Frame = caller;
+
+  if (!evaluated) return false;
+
+  // the body's value is dropped from a void function
+  if (Proto->getBinding()->Type->getReturnType() == TypeData::getType(sym_void))
+    return makeVoid(result);
+
+  return true;
+}
@@ -0,0 +1,222 @@
+// generic functions
+//
+// A generic function is only resolved when it is defined.  Each call is
+// typechecked against an instance for its argument types: the body is
+// copied, the prototype's type parameters are replaced by the types they
+// matched, and the copy goes through resolve, typecheck, fold and codegen
+// like any other definition.  Instances are named after the function and
+// their types, as in first.integer, and shared by every call that needs
+// the same one.
+
+#include <cstdio>
+#include <set>
+
+#include "ast.h"
+#include "resolve.h"
+
+// instances outlive the item whose call made them
+static Arena InstanceArena;
+
+// an instance calling for another of new types, as a generic over [T]
+// calling itself with [[T]], would go on forever
+static const unsigned MaxInstantiationDepth = 256;
+static unsigned InstantiationDepth = 0;
+
+// instances that didn't compile, so later calls fail the same way
+static std::set<Symbol> FailedInstances;
+
+static FunctionBinding *ErrorI(SourceLocation loc, const char *message) {
+  fprintf(stderr, "Error while instantiating at line %i, column %i: %s\n", loc.Line, loc.Column, message);
+  return 0;
+}
+
+static std::vector<ExprAST *> cloneAll(const ArenaArray<ExprAST *> &nodes) {
+  std::vector<ExprAST *> copies;
+  for (unsigned i = 0, e = nodes.size(); i < e; i++) {
+    copies.push_back(nodes[i]->Clone());
+  }
+  return copies;
+}
+
+// expressions
+
+ExprAST *BooleanExprAST::Clone() const {
+  return new BooleanExprAST(getLocation(), Val);
+}
+
+ExprAST *IntegerExprAST::Clone() const {
+  return new IntegerExprAST(getLocation(), Val);
+}
+
+ExprAST *NumberExprAST::Clone() const {
+  return new NumberExprAST(getLocation(), Val);
+}
+
+ExprAST *VariableExprAST::Clone() const {
+  return new VariableExprAST(getLocation(), Name);
+}
+
+ExprAST *BinaryExprAST::Clone() const {
+  return new BinaryExprAST(getLocation(), Op, LHS->Clone(), RHS->Clone());
+}
+
+ExprAST *CallExprAST::Clone() const {
+  CallExprAST *copy = new CallExprAST(getLocation(), Callee, cloneAll(Args));
+  if (RequireTail) copy->requireTail();
+  return copy;
+}
+
+ExprAST *ArrayLiteralExprAST::Clone() const {
+  std::vector<ExprAST *> elements = cloneAll(Elements);
+  return new ArrayLiteralExprAST(getLocation(), elements);
+}
+
+ExprAST *ArrayReferenceExprAST::Clone() const {
+  return new ArrayReferenceExprAST(getLocation(), Source->Clone(), Index->Clone());
+}
+
+ExprAST *SliceExprAST::Clone() const {
+  return new SliceExprAST(getLocation(), Source->Clone(), Start->Clone(), End->Clone());
+}
+
+ExprAST *EmbedExprAST::Clone() const {
+  return new EmbedExprAST(getLocation(), Path);
+}
+
+ExprAST *ValueLiteralAST::Clone() const {
+  return new ValueLiteralAST(getLocation(), ValueType, cloneAll(Fields));
+}
+
+ExprAST *ValueReferenceAST::Clone() const {
+  return new ValueReferenceAST(getLocation(), Source->Clone(), FieldReference);
+}
+
+ExprAST *BlockExprAST::Clone() const {
+  std::vector<ExprAST *> statements = cloneAll(Statements);
+  return new BlockExprAST(getLocation(), statements);
+}
+
+ExprAST *LetExprAST::Clone() const {
+  return new LetExprAST(getLocation(), Name, Value->Clone());
+}
+
+ExprAST *ConditionalExprAST::Clone() const {
+  return new ConditionalExprAST(getLocation(), Condition->Clone(), Consequent->Clone(), Alternate->Clone());
+}
+
+ExprAST *WhileExprAST::Clone() const {
+  return new WhileExprAST(getLocation(), Condition->Clone(), Body->Clone());
+}
+
+ExprAST *ForExprAST::Clone() const {
+  return new ForExprAST(getLocation(), Name, Start->Clone(), End->Clone(), Body->Clone());
+}
+
+// declarations
+
+bool PrototypeAST::Match(const std::vector<TypeData *> &argTypes, TypeParameters &params) {
+  for (unsigned i = 0, e = TypeParams.size(); i < e; i++) {
+    params[TypeParams[i]] = 0;
+  }
+
+  for (unsigned i = 0, e = ArgTypes.size(); i < e && i < argTypes.size(); i++) {
+    if (!ArgTypes[i]->Match(argTypes[i], params)) {
+      std::string message = "Conflicting types for a type parameter in call to ";
+      message += getSymbolName(Name);
+      ErrorI(Location, message.c_str());
+      return false;
+    }
+  }
+
+  for (unsigned i = 0, e = TypeParams.size(); i < e; i++) {
+    if (!params[TypeParams[i]]) {
+      std::string message = "Can't infer type parameter ";
+      message += getSymbolName(TypeParams[i]);
+      message += " of ";
+      message += getSymbolName(Name);
+      ErrorI(Location, message.c_str());
+      return false;
+    }
+  }
+
+  return true;
+}
+
+Symbol PrototypeAST::getInstanceName(const TypeParameters &params) {
+  std::string name = getSymbolName(Name);
+  for (unsigned i = 0, e = TypeParams.size(); i < e; i++) {
+    name += i ? "," : ".";
+    name += params.find(TypeParams[i])->second->getName();
+  }
+  return internSymbol(name);
+}
+
+PrototypeAST *PrototypeAST::Instantiate(Symbol name, const TypeParameters &params) {
+  TypeData *returns = Returns->Instantiate(params);
+  if (!returns) return 0;
+
+  std::vector<TypeSpecifier *> argTypes;
+  for (unsigned i = 0, e = ArgTypes.size(); i < e; i++) {
+    TypeData *argType = ArgTypes[i]->Instantiate(params);
+    if (!argType) return 0;
+
+    argTypes.push_back(new BasicTypeSpecifier(argType->getName()));
+  }
+
+  std::vector<Symbol> argNames(ArgNames.begin(), ArgNames.end());
+  TypeSpecifier *returnType = new BasicTypeSpecifier(returns->getName());
+
+  return new PrototypeAST(Location, name, returnType, argTypes, argNames);
+}
+
+FunctionBinding *FunctionAST::Instantiate(const std::vector<TypeData *> &argTypes, SourceLocation loc) {
+  TypeParameters params;
+  if (!Proto->Match(argTypes, params)) return 0;
+
+  Symbol instanceName = Proto->getInstanceName(params);
+
+  std::string message = "Couldn't instantiate ";
+  message += getSymbolName(instanceName);
+  if (FailedInstances.count(instanceName)) return ErrorI(loc, message.c_str());
+
+  // already made, or being made by a recursive call
+  FunctionBinding *existing = LookupFunction(instanceName);
+  if (existing && existing->Type) return existing;
+
+  if (InstantiationDepth >= MaxInstantiationDepth) {
+    std::string nested = "Instances nested too deeply at ";
+    nested += getSymbolName(instanceName);
+    return ErrorI(loc, nested.c_str());
+  }
+
+  Arena *previous = GetASTArena();
+  SetASTArena(&InstanceArena);
+
+  FunctionAST *instance = 0;
+  if (PrototypeAST *proto = Proto->Instantiate(instanceName, params)) {
+    instance = new FunctionAST(proto, Body->Clone());
+    if (MemoCapacity) instance->setMemo(MemoCapacity, Eviction);
+  }
+
+  InstantiationDepth++;
+  bool compiled = false;
+  if (instance && instance->Resolve() && instance->Typecheck()) {
+    instance->Fold();
+    compiled = instance->Codegen() != 0;
+  }
+  InstantiationDepth--;
+
+  SetASTArena(previous);
+
+  if (!compiled) {
+    // the binding was typed before the body failed, it mustn't be reused
+    FailedInstances.insert(instanceName);
+    if (FunctionBinding *failed = LookupFunction(instanceName)) {
+      failed->Type = 0;
+      failed->Definition = 0;
+    }
+    return ErrorI(loc, message.c_str());
+  }
+
+  return instance->getPrototype()->getBinding();
+}
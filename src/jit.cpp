@@ -0,0 +1,98 @@
+// jit
+
+#include <cstdio>
+#include <string>
+
+#include "emit.h"
+#include "jit.h"
+
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+
+using namespace llvm;
+
+static ExecutionEngine *Engine = 0;
+
+static ExecutionEngine *createEngine(Module *module, unsigned optLevel) {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+  InitializeNativeTargetAsmParser();
+
+  // putchar, getchar, malloc and friends come from the cli itself
+  sys::DynamicLibrary::LoadLibraryPermanently(0);
+
+  std::string error;
+  ExecutionEngine *engine = EngineBuilder(module)
+    .setEngineKind(EngineKind::JIT)
+    .setUseMCJIT(true)
+    .setMCJITMemoryManager(new SectionMemoryManager())
+    .setMCPU(sys::getHostCPUName())
+    .setOptLevel(getCodeGenOptLevel(optLevel))
+    .setErrorStr(&error)
+    .create();
+
+  if (!engine) {
+    fprintf(stderr, "Error creating JIT: %s\n", error.c_str());
+  }
+
+  return engine;
+}
+
+MainFunction CompileForExecution(Module *module, unsigned optLevel) {
+  Engine = createEngine(module, optLevel);
+  if (!Engine) return 0;
+
+  Engine->finalizeObject();
+
+  uint64_t address = Engine->getFunctionAddress("main");
+  if (!address) {
+    fprintf(stderr, "Error: no main function to run\n");
+    return 0;
+  }
+
+  return (MainFunction)address;
+}
+
+// session
+
+bool InitializeSession(Module *module, unsigned optLevel) {
+  Engine = createEngine(module, optLevel);
+  return Engine != 0;
+}
+
+void AddToSession(Module *module) {
+  Engine->addModule(module);
+}
+
+// Point the function's entry at a new body.  Callers load the entry on
+// every call, so a single store switches all of them over.
+bool ReplaceInSession(FunctionBinding *binding, Function *F) {
+  uint64_t body = Engine->getFunctionAddress(F->getName().str());
+  uint64_t entry = Engine->getGlobalValueAddress(binding->Entry->getName().str());
+  if (!body || !entry) {
+    fprintf(stderr, "Error: unable to replace function %s\n", getSymbolName(binding->Name).c_str());
+    return false;
+  }
+
+  Engine->finalizeObject();
+
+  __atomic_store_n((uint64_t *)entry, body, __ATOMIC_RELEASE);
+  return true;
+}
+
+void *GetSessionAddress(Function *F) {
+  uint64_t address = Engine->getFunctionAddress(F->getName().str());
+  if (!address) {
+    fprintf(stderr, "Error: unable to compile %s\n", F->getName().str().c_str());
+    return 0;
+  }
+
+  // applies relocations and makes the new code executable
+  Engine->finalizeObject();
+
+  return (void *)address;
+}
@@ -1,16 +1,23 @@
 // lexer
 
 #include <cctype>
+#include <cerrno>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "lexer.h"
 
-static std::string IdentifierStr;   // only valid if tok_identifier
+static Symbol IdentifierSym;        // only valid if tok_identifier
 static double NumberVal;            // only valid if tok_number
-static int IntegerVal;              // only valid if tok_integer
+static int64_t IntegerVal;          // only valid if tok_integer
+static std::string StringVal;       // only valid if tok_string
 
 static SourceLocation CurLoc;
 static SourceLocation LexLoc = { 1, 0 };
@@ -23,9 +30,103 @@ bool isNewline(int ch) {
   return ch == '\n' || ch == '\r';
 }
 
+// source buffer
+//
+// The source is either a read-only mapping of the whole input file or a
+// buffer filled from stdin in large chunks.  Identifiers and numbers are
+// scanned as slices of the buffer, so a refill moves the token in progress
+// to the front of the buffer to keep it contiguous.
+
+static const char *BufferCur = 0;   // next unread character
+static const char *BufferEnd = 0;   // one past the last valid character
+static const char *TokenStart = 0;  // start of the token being scanned
+
+static bool Mapped = false;
+static std::string SourceDirectory;
+static bool StdinDone = false;
+static char *StdinBuffer = 0;
+static size_t StdinCapacity = 0;
+
+static const size_t StdinChunkSize = 1 << 16;
+
+static bool refillBuffer() {
+  if (Mapped || StdinDone) return false;
+
+  size_t keep = TokenStart ? BufferEnd - TokenStart : 0;
+  size_t keepOffset = TokenStart ? TokenStart - StdinBuffer : 0;
+
+  if (keep + StdinChunkSize > StdinCapacity) {
+    size_t wanted = keep + StdinChunkSize;
+    StdinCapacity = 2 * StdinCapacity > wanted ? 2 * StdinCapacity : wanted;
+    StdinBuffer = (char *)realloc(StdinBuffer, StdinCapacity);
+  }
+
+  if (keep) memmove(StdinBuffer, StdinBuffer + keepOffset, keep);
+  if (TokenStart) TokenStart = StdinBuffer;
+
+  // read() rather than fread() so an interactive session gets each line
+  // as soon as it is typed
+  ssize_t count;
+  do {
+    count = read(STDIN_FILENO, StdinBuffer + keep, StdinCapacity - keep);
+  } while (count < 0 && errno == EINTR);
+
+  BufferCur = StdinBuffer + keep;
+
+  if (count <= 0) {
+    StdinDone = true;
+    BufferEnd = BufferCur;
+    return false;
+  }
+
+  BufferEnd = BufferCur + count;
+  return true;
+}
+
+bool OpenSourceFile(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat info;
+  if (fstat(fd, &info) < 0) {
+    close(fd);
+    return false;
+  }
+
+  Mapped = true;
+
+  const char *slash = strrchr(filename, '/');
+  SourceDirectory = slash ? std::string(filename, slash + 1) : "";
+
+  // an empty file can't be mapped, but it lexes just fine
+  if (info.st_size == 0) {
+    close(fd);
+    BufferCur = BufferEnd = 0;
+    return true;
+  }
+
+  void *data = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED) {
+    Mapped = false;
+    return false;
+  }
+
+  madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+  BufferCur = (const char *)data;
+  BufferEnd = BufferCur + info.st_size;
+
+  return true;
+}
+
 int advance() {
 
-  int LastChar = getchar();
+  if (BufferCur == BufferEnd && !refillBuffer())
+    return EOF;
+
+  int LastChar = (unsigned char)*BufferCur++;
 
   if (isNewline(LastChar)) {
     LexLoc.Line++;
@@ -38,19 +139,81 @@ int advance() {
 
 }
 
-std::map<std::string, int> Keywords;
+// the next character, without consuming it
+static int peek() {
+  if (BufferCur == BufferEnd && !refillBuffer())
+    return EOF;
+
+  return (unsigned char)*BufferCur;
+}
+
+// end of the token being scanned, given the character just read past it
+static const char *tokenEnd(int LastChar) {
+  return LastChar == EOF ? BufferCur : BufferCur - 1;
+}
+
+static bool matches(const char *str, unsigned length, const char *keyword) {
+  return 0 == memcmp(str, keyword, length);
+}
+
+// keywords are recognized by length and first character
+static int getKeyword(const char *str, unsigned length) {
+  switch (length) {
+  case 2:
+    switch (str[0]) {
+    case 'i':
+      if (matches(str, length, "if"))       return tok_if;
+      if (matches(str, length, "in"))       return tok_in;
+      break;
+    }
+    break;
+  case 3:
+    switch (str[0]) {
+    case 'f': if (matches(str, length, "for"))      return tok_for; break;
+    case 'l': if (matches(str, length, "let"))      return tok_let; break;
+    }
+    break;
+  case 4:
+    switch (str[0]) {
+    case 'e': if (matches(str, length, "else"))     return tok_else; break;
+    case 'm': if (matches(str, length, "memo"))     return tok_memo; break;
+    case 'p': if (matches(str, length, "pure"))     return tok_pure; break;
+    case 't':
+      if (matches(str, length, "true"))     return tok_true;
+      if (matches(str, length, "tail"))     return tok_tail;
+      break;
+    case 'v': if (matches(str, length, "void"))     return tok_void; break;
+    }
+    break;
+  case 5:
+    switch (str[0]) {
+    case 'e': if (matches(str, length, "embed"))    return tok_embed; break;
+    case 'f': if (matches(str, length, "false"))    return tok_false; break;
+    case 'v': if (matches(str, length, "value"))    return tok_value; break;
+    case 'w': if (matches(str, length, "while"))    return tok_while; break;
+    }
+    break;
+  case 6:
+    if (matches(str, length, "entity"))     return tok_entity;
+    break;
+  case 8:
+    switch (str[0]) {
+    case 'c': if (matches(str, length, "constant")) return tok_constant; break;
+    case 'e': if (matches(str, length, "external")) return tok_external; break;
+    case 'f': if (matches(str, length, "function")) return tok_function; break;
+    }
+    break;
+  }
+  return tok_identifier;
+}
 
 void InitializeLexer() {
 
-  Keywords["value"]     = tok_value;
-  Keywords["entity"]    = tok_entity;
-  Keywords["external"]  = tok_external;
-  Keywords["function"]  = tok_function;
-  Keywords["false"]     = tok_false;
-  Keywords["true"]      = tok_true;
-  Keywords["void"]      = tok_void;
-  Keywords["if"]        = tok_if;
-  Keywords["else"]      = tok_else;
+  // read from stdin unless a source file is opened
+  Mapped = false;
+  SourceDirectory.clear();
+  StdinDone = false;
+  BufferCur = BufferEnd = TokenStart = 0;
 
 }
 
@@ -67,36 +230,79 @@ int gettok() {
   CurLoc = LexLoc;
 
   if (isalpha(LastChar)) {
-    IdentifierStr = LastChar;
+    TokenStart = BufferCur - 1;
     while (isalnum((LastChar = advance())))
-      IdentifierStr += LastChar;
+      ;
 
-    if (Keywords.count(IdentifierStr) > 0) {
-      return Keywords[IdentifierStr];
-    }
+    const char *IdentifierStart = TokenStart;
+    unsigned IdentifierLength = tokenEnd(LastChar) - TokenStart;
+    TokenStart = 0;
+
+    int keyword = getKeyword(IdentifierStart, IdentifierLength);
+    if (keyword != tok_identifier)
+      return keyword;
 
+    IdentifierSym = internSymbol(IdentifierStart, IdentifierLength);
     return tok_identifier;
   }
 
   if (isdigit(LastChar)) {
     bool isDouble = false;
+    bool overflow = false;
+    uint64_t IntegerAcc = 0;
 
-    std::string NumStr;
+    TokenStart = BufferCur - 1;
     do {
-      isDouble = isDouble || LastChar == '.';
+      if (LastChar == '.')
+        isDouble = true;
+      else if (IntegerAcc > ((uint64_t)INT64_MAX - (LastChar - '0')) / 10)
+        overflow = true;
+      else
+        IntegerAcc = IntegerAcc * 10 + (LastChar - '0');
 
-      NumStr += LastChar;
       LastChar = advance();
+
+      // the start of a range, as in 0..10
+      if (LastChar == '.' && peek() == '.')
+        break;
     } while (isdigit(LastChar) || LastChar == '.');
 
+    const char *NumEnd = tokenEnd(LastChar);
+    const char *NumStart = TokenStart;
+    TokenStart = 0;
+
     if (isDouble) {
+      // the slice isn't terminated, so strtod needs a copy
+      std::string NumStr(NumStart, NumEnd);
       NumberVal = strtod(NumStr.c_str(), 0);
       return tok_number;
     }
-    IntegerVal = atoi(NumStr.c_str());
+
+    // too big for an integer, leave the first digit for the parser to
+    // complain about
+    if (overflow) {
+      fprintf(stderr, "Error while lexing at line %i, column %i: Integer literal out of range: %.*s\n",
+              CurLoc.Line, CurLoc.Column, (int)(NumEnd - NumStart), NumStart);
+      return *NumStart;
+    }
+
+    IntegerVal = (int64_t)IntegerAcc;
     return tok_integer;
   }
 
+  // strings run to the closing quote on the same line, with no escapes
+  if (LastChar == '"') {
+    StringVal.clear();
+    while ((LastChar = advance()) != EOF && LastChar != '"' && !isNewline(LastChar))
+      StringVal += (char)LastChar;
+
+    // unterminated, leave the quote for the parser to complain about
+    if (LastChar != '"') return '"';
+
+    LastChar = advance();
+    return tok_string;
+  }
+
   if (LastChar == '#') {
     do {
       LastChar = advance();
@@ -111,18 +317,37 @@ int gettok() {
 
   int ThisChar = LastChar;
   LastChar = advance();
+
+  if (ThisChar == '.' && LastChar == '.') {
+    LastChar = advance();
+    return tok_range;
+  }
+
   return ThisChar;
 
 }
 
-const std::string getIdentifierStr() {
-  return IdentifierStr;
+Symbol getIdentifierSymbol() {
+  return IdentifierSym;
+}
+
+const std::string &getIdentifierStr() {
+  return getSymbolName(IdentifierSym);
 }
 
 double getNumberVal() {
   return NumberVal;
 }
 
-int getIntegerVal() {
+int64_t getIntegerVal() {
   return IntegerVal;
 }
+
+const std::string &getStringVal() {
+  return StringVal;
+}
+
+std::string getSourceRelativePath(const std::string &path) {
+  if (path.empty() || path[0] == '/') return path;
+  return SourceDirectory + path;
+}
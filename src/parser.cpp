@@ -47,6 +47,11 @@ TypeSpecifier *ErrorTS(const char* message) {
   return 0;
 }
 
+ConstantAST *ErrorC(const char* message) {
+  Error(message);
+  return 0;
+}
+
 // recursive descent parsing
 
 static ExprAST* ParseExpression();
@@ -115,16 +120,16 @@ static bool parseArgumentList(int ch, std::vector<ExprAST*> *Args) {
   return true;
 }
 
-static ExprAST *parseFunctionCall(std::string IdName, SourceLocation loc) {
+static ExprAST *parseFunctionCall(Symbol IdName, SourceLocation loc) {
   getNextToken(); // eat (
 
-  std::vector<ExprAST*> *Args = new std::vector<ExprAST*>();
-  bool success = parseArgumentList(')', Args);
+  std::vector<ExprAST*> Args;
+  bool success = parseArgumentList(')', &Args);
   if (!success) return 0;
 
   getNextToken(); // eat )
 
-  return new CallExprAST(loc, IdName, *Args);
+  return new CallExprAST(loc, IdName, Args);
 }
 
 static ExprAST *parseArrayReference(ExprAST *var) {
@@ -138,24 +143,35 @@ static ExprAST *parseArrayReference(ExprAST *var) {
   ExprAST *index = ParseExpression();
   if (!index) return 0;
 
+  // a[start..end] is a slice
+  ExprAST *end = 0;
+  if (getCurrentToken() == tok_range) {
+    getNextToken(); // eat ..
+
+    end = ParseExpression();
+    if (!end) return 0;
+  }
+
   if (getCurrentToken() != ']')
     return Error("Expecting ] in array reference");
 
   getNextToken(); // eat ]
 
+  if (end) return new SliceExprAST(loc, var, index, end);
+
   return new ArrayReferenceExprAST(loc, var, index);
 }
 
-static ExprAST *parseStructLiteral(std::string IdName, SourceLocation loc) {
+static ExprAST *parseStructLiteral(Symbol IdName, SourceLocation loc) {
   getNextToken(); // eat {
 
-  std::vector<ExprAST*> *Args = new std::vector<ExprAST*>();
-  bool success = parseArgumentList('}', Args);
+  std::vector<ExprAST*> Args;
+  bool success = parseArgumentList('}', &Args);
   if (!success) return 0;
 
   getNextToken(); // eat }
 
-  return new ValueLiteralAST(loc, IdName, *Args);
+  return new ValueLiteralAST(loc, IdName, Args);
 }
 
 static ExprAST *parseStructReference(ExprAST *var) {
@@ -165,7 +181,7 @@ static ExprAST *parseStructReference(ExprAST *var) {
   if (getNextToken() != tok_identifier)
     return Error("Expecting identifier in struct reference");
 
-  std::string reference = getIdentifierStr();
+  Symbol reference = getIdentifierSymbol();
 
   getNextToken(); // eat identifier
 
@@ -178,12 +194,12 @@ static ExprAST *parseStructReference(ExprAST *var) {
 //    ::= identifier '(' expression* ')'
 //    ::= identifier '{' expression* '}'
 static ExprAST *ParseIdentifierExpr() {
-  std::string IdName = getIdentifierStr();
+  Symbol IdName = getIdentifierSymbol();
   SourceLocation loc = getCurrentLocation();
 
   getNextToken(); // eat the identifier
 
-  //fprintf(stderr, "id %s, next tok %i as %c\n", IdName.c_str(), CurTok, CurTok);
+  //fprintf(stderr, "id %s, next tok %i as %c\n", getSymbolName(IdName).c_str(), CurTok, CurTok);
 
   switch (CurTok) {
   case '(': return parseFunctionCall(IdName, loc);
@@ -224,7 +240,29 @@ static ExprAST* ParseArrayExpr() {
 
   return new ArrayLiteralExprAST(loc, elements);
 }
-// blockexpr ::= expression+
+// letexpr ::= 'let' identifier '=' expression
+static ExprAST *ParseLetExpr() {
+  SourceLocation loc = getCurrentLocation();
+  getNextToken(); // eat 'let'
+
+  if (tok_identifier != CurTok) {
+    return Error("Expecting name after 'let'");
+  }
+  Symbol name = getIdentifierSymbol();
+  getNextToken(); // eat the identifier
+
+  if ('=' != CurTok) {
+    return Error("Expecting '=' in let");
+  }
+  getNextToken(); // eat '='
+
+  ExprAST *value = ParseExpression();
+  if (!value) return 0;
+
+  return new LetExprAST(loc, name, value);
+}
+
+// blockexpr ::= (letexpr | expression)+
 static ExprAST *ParseBlockExpr() {
   if ('{' != getCurrentToken()) {
     return Error("Expecting { to start block");
@@ -234,7 +272,10 @@ static ExprAST *ParseBlockExpr() {
   std::vector<ExprAST *> statements;
   int tok;
   while (1) {
-    statements.push_back(ParseExpression());
+    if (tok_let == getCurrentToken())
+      statements.push_back(ParseLetExpr());
+    else
+      statements.push_back(ParseExpression());
 
     if (!statements.back()) {
       return 0;
@@ -278,8 +319,98 @@ static ExprAST *ParseConditionalExpr() {
   return new ConditionalExprAST(getCurrentLocation(), condition, consequent, alternate);
 }
 
+// whileexpr ::= 'while' expression expression
+static ExprAST *ParseWhileExpr() {
+  SourceLocation loc = getCurrentLocation();
+  getNextToken(); // eat 'while'
+
+  ExprAST *condition = ParseExpression();
+  if (!condition) return 0;
+
+  ExprAST *body = ParseExpression();
+  if (!body) return 0;
+
+  return new WhileExprAST(loc, condition, body);
+}
+
+// forexpr ::= 'for' identifier 'in' expression '..' expression expression
+static ExprAST *ParseForExpr() {
+  SourceLocation loc = getCurrentLocation();
+  getNextToken(); // eat 'for'
+
+  if (tok_identifier != CurTok) {
+    return Error("Expecting loop variable after 'for'");
+  }
+  Symbol name = getIdentifierSymbol();
+  getNextToken(); // eat the identifier
+
+  if (tok_in != CurTok) {
+    return Error("Expecting 'in' after loop variable");
+  }
+  getNextToken(); // eat 'in'
+
+  ExprAST *start = ParseExpression();
+  if (!start) return 0;
+
+  if (tok_range != CurTok) {
+    return Error("Expecting '..' in loop range");
+  }
+  getNextToken(); // eat '..'
+
+  ExprAST *end = ParseExpression();
+  if (!end) return 0;
+
+  ExprAST *body = ParseExpression();
+  if (!body) return 0;
+
+  return new ForExprAST(loc, name, start, end, body);
+}
+
+// tailcallexpr ::= 'tail' identifier '(' expression* ')'
+static ExprAST *ParseTailCallExpr() {
+  getNextToken(); // eat 'tail'
+
+  if (tok_identifier != CurTok) {
+    return Error("expecting a function call after 'tail'");
+  }
+
+  Symbol IdName = getIdentifierSymbol();
+  SourceLocation loc = getCurrentLocation();
+
+  getNextToken(); // eat the identifier
+
+  if ('(' != CurTok) {
+    return Error("expecting a function call after 'tail'");
+  }
+
+  CallExprAST *call = (CallExprAST *)parseFunctionCall(IdName, loc);
+  if (!call) return 0;
+
+  call->requireTail();
+  return call;
+}
+
+// embedexpr ::= 'embed' string
+static ExprAST *ParseEmbedExpr() {
+  SourceLocation loc = getCurrentLocation();
+
+  if (tok_string != getNextToken()) {
+    return Error("expecting a quoted file name after 'embed'");
+  }
+
+  Symbol path = internSymbol(getSourceRelativePath(getStringVal()));
+
+  getNextToken(); // eat the file name
+
+  return new EmbedExprAST(loc, path);
+}
+
 // primary
 //    ::= identifierexpr
+//    ::= tailcallexpr
+//    ::= embedexpr
+//    ::= whileexpr
+//    ::= forexpr
 //    ::= integerexpr
 //    ::= numberexpr
 //    ::= conditionalexpr
@@ -293,6 +424,10 @@ static ExprAST *ParsePrimary() {
   case tok_integer:     return ParseIntegerExpr();
   case tok_number:      return ParseNumberExpr();
   case tok_if:          return ParseConditionalExpr();
+  case tok_tail:        return ParseTailCallExpr();
+  case tok_while:       return ParseWhileExpr();
+  case tok_for:         return ParseForExpr();
+  case tok_embed:       return ParseEmbedExpr();
 
   case tok_false:
   case tok_true:
@@ -373,6 +508,38 @@ static ExprAST *ParseExpression() {
 
 // infrastructure
 
+static TypeSpecifier *parseTypeName();
+
+// functiontype ::= '(' (type (',' type)*)? ')' (type | 'void')
+static TypeSpecifier *parseFunctionTypeName() {
+  getNextToken(); // eat (
+
+  std::vector<TypeSpecifier *> takes;
+  while (getCurrentToken() != ')') {
+    TypeSpecifier *parameter = parseTypeName();
+    if (!parameter) return 0;
+
+    takes.push_back(parameter);
+
+    if (getCurrentToken() == ')') break;
+
+    if (getCurrentToken() != ',')
+      return ErrorTS("Expected ',' or ')' in function type");
+
+    getNextToken(); // eat ,
+  }
+
+  if (getNextToken() == tok_void) { // eat )
+    getNextToken(); // eat void
+    return new FunctionTypeSpecifier(new BasicTypeSpecifier("void"), takes);
+  }
+
+  TypeSpecifier *returns = parseTypeName();
+  if (!returns) return 0;
+
+  return new FunctionTypeSpecifier(returns, takes);
+}
+
 static TypeSpecifier *parseTypeName() {
   std::string t;
   switch (getCurrentToken()) {
@@ -384,16 +551,25 @@ static TypeSpecifier *parseTypeName() {
     getNextToken(); // eat identifier
     return new BasicTypeSpecifier(t);
 
+  case '(':
+    return parseFunctionTypeName();
+
   case '[':
     getNextToken(); // eat [
     TypeSpecifier *nested = parseTypeName();
     if (!nested) return 0;
 
+    // [T..] is a slice of T
+    bool slice = tok_range == getCurrentToken();
+    if (slice) getNextToken(); // eat ..
+
     if (']' != getCurrentToken()) {
       return ErrorTS("Expected ] to end type");
     }
     getNextToken(); // eat ]
 
+    if (slice) return new SliceTypeSpecifier(nested);
+
     return new ArrayTypeSpecifier(nested);
   }
 }
@@ -408,13 +584,13 @@ ValueTypeAST *ParseValueTypeDefinition() {
   if (getNextToken() != tok_identifier)
     return ErrorVT("Expected value type name");
 
-  std::string typeName = getIdentifierStr();
+  Symbol typeName = getIdentifierSymbol();
 
   if (getNextToken() != '{')
     return ErrorVT("Expected { to start value type ");
 
   std::vector<TypeSpecifier *> elTypes;
-  std::vector<std::string> elNames;
+  std::vector<Symbol> elNames;
 
   while (getNextToken() != '}') {
     TypeSpecifier *parseType = parseTypeName();
@@ -426,7 +602,7 @@ ValueTypeAST *ParseValueTypeDefinition() {
     if (getCurrentToken() != tok_identifier)
       return ErrorVT("Expected element name");
 
-    elNames.push_back(getIdentifierStr());
+    elNames.push_back(getIdentifierSymbol());
   }
 
   getNextToken(); // eat '}'
@@ -447,7 +623,7 @@ static PrototypeAST *ParsePrototype() {
   getNextToken(); // eat (
 
   std::vector<TypeSpecifier *> ArgTypes;
-  std::vector<std::string> ArgNames;
+  std::vector<Symbol> ArgNames;
 
   while (getCurrentToken() != ')') {
 
@@ -460,7 +636,7 @@ static PrototypeAST *ParsePrototype() {
     if (getCurrentToken() != tok_identifier)
       return ErrorP("Expected parameter name in prototype");
 
-    ArgNames.push_back(getIdentifierStr());
+    ArgNames.push_back(getIdentifierSymbol());
 
     if (getNextToken() == ')') break;
 
@@ -484,7 +660,7 @@ static PrototypeAST *ParsePrototype() {
   if (getCurrentToken() != tok_identifier)
     return ErrorP("Expected function name in prototype");
 
-  std::string FnName = getIdentifierStr();
+  Symbol FnName = getIdentifierSymbol();
 
   getNextToken(); // eat name
 
@@ -496,19 +672,100 @@ ExprAST* ParseTopLevelExpr() {
   return ParseExpression();
 }
 
+static const unsigned DefaultMemoCapacity = 1024;
+static const unsigned MaxMemoCapacity = 1 << 24;
+
+// definition ::= memo? 'function' typeparams? prototype expression
+// memo ::= 'memo' ('(' integer (',' identifier)? ')')?
+// typeparams ::= '<' identifier (',' identifier)* '>'
 FunctionAST *ParseFunctionDefinition() {
-  SourceLocation loc = getCurrentLocation();
-  getNextToken(); // eat function
+  unsigned capacity = 0;
+  MemoEviction eviction = evict_replace;
+
+  if (getCurrentToken() == tok_memo) {
+    capacity = DefaultMemoCapacity;
+
+    if (getNextToken() == '(') { // eat memo
+      if (getNextToken() != tok_integer) // eat (
+        return ErrorF("Expected memo table capacity");
+
+      if (getIntegerVal() < 1 || getIntegerVal() > MaxMemoCapacity)
+        return ErrorF("Memo table capacity out of range");
+      capacity = getIntegerVal();
+
+      if (getNextToken() == ',') { // eat capacity
+        if (getNextToken() != tok_identifier) // eat ,
+          return ErrorF("Expected memo eviction policy");
+
+        if (getIdentifierStr() == "replace") eviction = evict_replace;
+        else if (getIdentifierStr() == "keep") eviction = evict_keep;
+        else return ErrorF("Unknown memo eviction policy, expected replace or keep");
+
+        getNextToken(); // eat policy
+      }
+
+      if (getCurrentToken() != ')')
+        return ErrorF("Expected ) after memo options");
+      getNextToken(); // eat )
+    }
+
+    if (getCurrentToken() != tok_function)
+      return ErrorF("Expected function after memo");
+  }
+
+  std::vector<Symbol> typeParams;
+  if (getNextToken() == '<') { // eat function
+    do {
+      if (getNextToken() != tok_identifier) // eat < or ,
+        return ErrorF("Expected type parameter name");
+
+      typeParams.push_back(getIdentifierSymbol());
+    } while (getNextToken() == ','); // eat name
+
+    if (getCurrentToken() != '>')
+      return ErrorF("Expected > after type parameters");
+    getNextToken(); // eat >
+  }
+
   PrototypeAST *Proto = ParsePrototype();
   if (!Proto) return 0;
 
+  if (typeParams.size()) Proto->setTypeParameters(typeParams);
+
   ExprAST* Body = ParseExpression();
   if (!Body) return 0;
 
-  return new FunctionAST(Proto, Body);
+  FunctionAST *definition = new FunctionAST(Proto, Body);
+  if (capacity) definition->setMemo(capacity, eviction);
+  return definition;
 }
 
+// external ::= 'external' 'pure'? prototype
 PrototypeAST *ParseExternalDeclaration() {
-  getNextToken(); // eat external
-  return ParsePrototype();
+  bool pure = getNextToken() == tok_pure; // eat external
+  if (pure) getNextToken(); // eat pure
+
+  PrototypeAST *proto = ParsePrototype();
+  if (proto && pure) proto->setPure();
+  return proto;
+}
+
+// constant ::= 'constant' identifier '=' expression
+ConstantAST *ParseConstantDefinition() {
+  SourceLocation loc = getCurrentLocation();
+
+  if (getNextToken() != tok_identifier)
+    return ErrorC("Expected constant name");
+
+  Symbol name = getIdentifierSymbol();
+
+  if (getNextToken() != '=')
+    return ErrorC("Expected = after constant name");
+
+  getNextToken(); // eat =
+
+  ExprAST *value = ParseExpression();
+  if (!value) return 0;
+
+  return new ConstantAST(loc, name, value);
 }
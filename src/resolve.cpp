@@ -0,0 +1,433 @@
+// resolve
+
+#include <cstdio>
+#include <unordered_map>
+
+#include "ast.h"
+#include "resolve.h"
+
+void ResolveError(SourceLocation loc, const char *message) {
+  fprintf(stderr, "Error while resolving names at line %i, column %i: %s\n", loc.Line, loc.Column, message);
+}
+
+bool ErrorR(ExprAST *e, const char *message) {
+  ResolveError(e->getLocation(), message);
+  return false;
+}
+
+// declared functions
+
+static std::unordered_map<Symbol, FunctionBinding *> Functions;
+
+FunctionBinding *DeclareFunction(Symbol name) {
+  FunctionBinding *&binding = Functions[name];
+  if (!binding) binding = new FunctionBinding(name);
+  return binding;
+}
+
+FunctionBinding *LookupFunction(Symbol name) {
+  std::unordered_map<Symbol, FunctionBinding *>::iterator found = Functions.find(name);
+  return found == Functions.end() ? 0 : found->second;
+}
+
+// top-level constants
+
+static std::unordered_map<Symbol, ConstantBinding *> Constants;
+
+ConstantBinding *DeclareConstant(Symbol name) {
+  ConstantBinding *&binding = Constants[name];
+  if (binding) return 0;
+
+  binding = new ConstantBinding(name);
+  return binding;
+}
+
+ConstantBinding *LookupConstant(Symbol name) {
+  std::unordered_map<Symbol, ConstantBinding *>::iterator found = Constants.find(name);
+  return found == Constants.end() ? 0 : found->second;
+}
+
+// self calls in the function being resolved
+
+static FunctionBinding *CurrentFunction = 0;
+static unsigned SelfCalls = 0;
+
+// expressions
+
+bool BooleanExprAST::Resolve(Scope *scope) {
+  return true;
+}
+
+bool IntegerExprAST::Resolve(Scope *scope) {
+  return true;
+}
+
+bool NumberExprAST::Resolve(Scope *scope) {
+  return true;
+}
+
+bool VariableExprAST::Resolve(Scope *scope) {
+  int slot = scope ? scope->lookup(Name) : -1;
+  if (slot >= 0) {
+    Slot = slot;
+    return true;
+  }
+
+  Binding = LookupConstant(Name);
+  if (Binding) return true;
+
+  FunctionRef = LookupFunction(Name);
+  if (!FunctionRef) {
+    std::string message = "Unknown variable name: ";
+    message += getSymbolName(Name);
+    return ErrorR(this, message.c_str());
+  }
+
+  return true;
+}
+
+bool BinaryExprAST::Resolve(Scope *scope) {
+  return LHS->Resolve(scope) && RHS->Resolve(scope);
+}
+
+bool CallExprAST::Resolve(Scope *scope) {
+  for (unsigned i = 0, e = Args.size(); i < e; i++) {
+    if (!Args[i]->Resolve(scope)) return false;
+  }
+
+  if (isBuiltin()) return true;
+
+  int slot = scope ? scope->lookup(Callee) : -1;
+  if (slot >= 0) {
+    Indirect = true;
+    Slot = slot;
+    return true;
+  }
+
+  // a session resolves a line again when wrapping it, and a generic call
+  // keeps the instance it was typechecked against
+  FunctionBinding *found = LookupFunction(Callee);
+  if (!Binding || !found || !found->Generic) Binding = found;
+
+  if (!Binding) {
+    std::string message = "Unknown function reference: ";
+    message += getSymbolName(Callee);
+    return ErrorR(this, message.c_str());
+  }
+
+  if (Binding == CurrentFunction) SelfCalls++;
+
+  return true;
+}
+
+bool ArrayLiteralExprAST::Resolve(Scope *scope) {
+  for (unsigned i = 0, e = Elements.size(); i < e; i++) {
+    if (!Elements[i]->Resolve(scope)) return false;
+  }
+  return true;
+}
+
+bool ArrayReferenceExprAST::Resolve(Scope *scope) {
+  return Source->Resolve(scope) && Index->Resolve(scope);
+}
+
+bool SliceExprAST::Resolve(Scope *scope) {
+  return Source->Resolve(scope) && Start->Resolve(scope) && End->Resolve(scope);
+}
+
+bool EmbedExprAST::Resolve(Scope *scope) {
+  return true;
+}
+
+bool ValueLiteralAST::Resolve(Scope *scope) {
+  for (unsigned i = 0, e = Fields.size(); i < e; i++) {
+    if (!Fields[i]->Resolve(scope)) return false;
+  }
+  return true;
+}
+
+bool ValueReferenceAST::Resolve(Scope *scope) {
+  return Source->Resolve(scope);
+}
+
+bool BlockExprAST::Resolve(Scope *scope) {
+  // top-level expressions have no function to number slots in
+  unsigned topLevelSlots = 0;
+  Scope root(&topLevelSlots);
+  Scope block(scope ? scope : &root);
+
+  for (unsigned i = 0, e = Statements.size(); i < e; i++) {
+    if (!Statements[i]->Resolve(&block)) return false;
+  }
+  return true;
+}
+
+bool LetExprAST::Resolve(Scope *scope) {
+  // the value can't see the name it is bound to
+  if (!Value->Resolve(scope)) return false;
+
+  Slot = scope->bind(Name);
+  return true;
+}
+
+bool ConditionalExprAST::Resolve(Scope *scope) {
+  return Condition->Resolve(scope)
+      && Consequent->Resolve(scope)
+      && Alternate->Resolve(scope);
+}
+
+bool WhileExprAST::Resolve(Scope *scope) {
+  return Condition->Resolve(scope) && Body->Resolve(scope);
+}
+
+bool ForExprAST::Resolve(Scope *scope) {
+  if (!Start->Resolve(scope) || !End->Resolve(scope)) return false;
+
+  // top-level expressions have no function to number slots in
+  unsigned topLevelSlots = 0;
+  Scope root(&topLevelSlots);
+  Scope body(scope ? scope : &root);
+
+  Slot = body.bind(Name);
+  return Body->Resolve(&body);
+}
+
+// tail positions
+
+void CallExprAST::MarkTailPosition(TailCalls *calls) {
+  if (isBuiltin()) return;
+
+  Tail = true;
+  if (Binding == calls->Self) calls->Direct++;
+}
+
+CallExprAST *CallExprAST::getCallTo(FunctionBinding *function) {
+  return !isBuiltin() && Binding == function ? this : 0;
+}
+
+// the operand is evaluated before the call, unless it is the right hand
+// side, so then it must not have any effects to reorder
+void BinaryExprAST::MarkTailPosition(TailCalls *calls) {
+  if (Op != '+' && Op != '*' && Op != '&' && Op != '|') return;
+
+  if ((SelfCall = RHS->getCallTo(calls->Self))) {
+    Operand = LHS;
+  }
+  else if ((SelfCall = LHS->getCallTo(calls->Self)) && !RHS->MayHaveEffects()) {
+    Operand = RHS;
+  }
+  else {
+    SelfCall = 0;
+    return;
+  }
+
+  if (calls->Accumulated++ == 0) calls->Operator = Op;
+  if (calls->Operator != Op) calls->Mixed = true;
+}
+
+void BlockExprAST::MarkTailPosition(TailCalls *calls) {
+  if (Statements.size()) Statements[Statements.size() - 1]->MarkTailPosition(calls);
+}
+
+void ConditionalExprAST::MarkTailPosition(TailCalls *calls) {
+  Consequent->MarkTailPosition(calls);
+  Alternate->MarkTailPosition(calls);
+}
+
+// effects
+
+// builtins are computed in place, any other call may have effects
+bool CallExprAST::MayHaveEffects() const {
+  if (!isBuiltin()) return true;
+
+  for (unsigned i = 0, e = Args.size(); i < e; i++) {
+    if (Args[i]->MayHaveEffects()) return true;
+  }
+  return false;
+}
+
+bool BinaryExprAST::MayHaveEffects() const {
+  return LHS->MayHaveEffects() || RHS->MayHaveEffects();
+}
+
+bool ArrayReferenceExprAST::MayHaveEffects() const {
+  return Source->MayHaveEffects() || Index->MayHaveEffects();
+}
+
+bool SliceExprAST::MayHaveEffects() const {
+  return Source->MayHaveEffects() || Start->MayHaveEffects() || End->MayHaveEffects();
+}
+
+bool ValueReferenceAST::MayHaveEffects() const {
+  return Source->MayHaveEffects();
+}
+
+bool ConditionalExprAST::MayHaveEffects() const {
+  return Condition->MayHaveEffects()
+      || Consequent->MayHaveEffects()
+      || Alternate->MayHaveEffects();
+}
+
+// inferred effects
+//
+// Arrays are immutable, so a function that only reads them can be marked
+// readonly and one that reads no memory at all readnone.  Allocating a
+// new array writes memory, so it has any effect.  A while loop or a
+// recursive call isn't known to finish, and LLVM may drop a readnone call
+// whose result is unused, so either leaves the function unmarked.
+
+static Effect combine(Effect a, Effect b) {
+  return a > b ? a : b;
+}
+
+Effect VariableExprAST::getEffect() const {
+  // a constant that wasn't folded is loaded from its global, a function
+  // named as a value is just its address
+  return Binding ? effect_reads : effect_none;
+}
+
+Effect BinaryExprAST::getEffect() const {
+  return combine(LHS->getEffect(), RHS->getEffect());
+}
+
+Effect CallExprAST::getEffect() const {
+  Effect effect = isLength() ? effect_reads
+                : isBuiltin() ? effect_none
+                : Binding ? Binding->Effects : effect_any;
+
+  for (unsigned i = 0, e = Args.size(); i < e && effect != effect_any; i++) {
+    effect = combine(effect, Args[i]->getEffect());
+  }
+  return effect;
+}
+
+// only a literal made of constants is emitted as a global, see codegen
+Effect ArrayLiteralExprAST::getEffect() const {
+  for (unsigned i = 0, e = Elements.size(); i < e; i++) {
+    if (!Elements[i]->isLiteral() || Elements[i]->getEffect() != effect_none) return effect_any;
+  }
+  return effect_none;
+}
+
+Effect ArrayReferenceExprAST::getEffect() const {
+  return combine(effect_reads, combine(Source->getEffect(), Index->getEffect()));
+}
+
+Effect SliceExprAST::getEffect() const {
+  Effect effect = combine(Source->getEffect(), combine(Start->getEffect(), End->getEffect()));
+  return combine(effect_reads, effect);
+}
+
+Effect ValueLiteralAST::getEffect() const {
+  Effect effect = effect_none;
+  for (unsigned i = 0, e = Fields.size(); i < e; i++) {
+    effect = combine(effect, Fields[i]->getEffect());
+  }
+  return effect;
+}
+
+Effect ValueReferenceAST::getEffect() const {
+  return Source->getEffect();
+}
+
+Effect BlockExprAST::getEffect() const {
+  Effect effect = effect_none;
+  for (unsigned i = 0, e = Statements.size(); i < e; i++) {
+    effect = combine(effect, Statements[i]->getEffect());
+  }
+  return effect;
+}
+
+Effect LetExprAST::getEffect() const {
+  return Value->getEffect();
+}
+
+Effect ConditionalExprAST::getEffect() const {
+  Effect effect = combine(Condition->getEffect(), Consequent->getEffect());
+  return combine(effect, Alternate->getEffect());
+}
+
+Effect WhileExprAST::getEffect() const {
+  Effect effect = combine(Condition->getEffect(), Body->getEffect());
+  return combine(effect_loops, effect);
+}
+
+Effect ForExprAST::getEffect() const {
+  Effect effect = combine(Start->getEffect(), End->getEffect());
+  return combine(effect, Body->getEffect());
+}
+
+// recursive calls start out assuming they may not return, and the body is
+// inferred again until that assumption holds
+Effect FunctionAST::InferEffect() {
+  FunctionBinding *binding = Proto->getBinding();
+  binding->Effects = effect_loops;
+
+  Effect effect;
+  while ((effect = Body->getEffect()) != binding->Effects) {
+    binding->Effects = effect;
+  }
+  return effect;
+}
+
+// declarations
+
+bool PrototypeAST::Resolve(Scope *scope) {
+  Binding = DeclareFunction(Name);
+  if (Pure) Binding->Effects = effect_none;
+
+  // arguments take the first slots, in order
+  if (scope) {
+    for (unsigned i = 0, e = ArgNames.size(); i < e; i++) {
+      scope->bind(ArgNames[i]);
+    }
+  }
+
+  return true;
+}
+
+bool ConstantAST::Resolve() {
+  // the value can't refer to the constant it defines
+  if (!Value->Resolve(0)) return false;
+
+  Binding = DeclareConstant(Name);
+  if (!Binding) {
+    std::string message = "Constant already defined: ";
+    message += getSymbolName(Name);
+    ResolveError(Location, message.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool FunctionAST::Resolve() {
+  NumSlots = 0;
+  Scope arguments(&NumSlots);
+
+  // declared first so the body can recurse
+  if (!Proto->Resolve(&arguments)) return false;
+
+  // checked for names now, and typechecked once per instance
+  Proto->getBinding()->Generic = isGeneric() ? this : 0;
+
+  CurrentFunction = Proto->getBinding();
+  SelfCalls = 0;
+
+  bool resolved = Body->Resolve(&arguments);
+  CurrentFunction = 0;
+  if (!resolved) return false;
+
+  TailCalls calls(Proto->getBinding());
+  Body->MarkTailPosition(&calls);
+
+  SelfTailCalls = calls.Direct > 0;
+
+  // an accumulator only replaces the stack if every self call is covered
+  AccumulatorOp = 0;
+  if (calls.Accumulated && !calls.Mixed && calls.Direct + calls.Accumulated == SelfCalls) {
+    AccumulatorOp = calls.Operator;
+  }
+
+  return true;
+}
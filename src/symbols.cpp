@@ -0,0 +1,102 @@
+// symbols
+
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include "symbols.h"
+
+// names are kept in a deque so references handed out stay valid as it grows
+static std::deque<std::string> Names;
+static std::vector<unsigned> Hashes;
+
+// open addressing, holds symbol + 1 so that zero marks an empty bucket
+static std::vector<unsigned> Buckets;
+
+static unsigned hashName(const char *str, unsigned length) {
+  // FNV-1a
+  unsigned hash = 2166136261u;
+  for (unsigned i = 0; i < length; i++) {
+    hash ^= (unsigned char)str[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static Symbol insertName(const char *str, unsigned length, unsigned hash);
+
+static void growBuckets() {
+  unsigned size = Buckets.empty() ? 256 : 2 * Buckets.size();
+  Buckets.assign(size, 0);
+
+  unsigned mask = size - 1;
+  for (unsigned s = 0, e = Names.size(); s < e; s++) {
+    unsigned i = Hashes[s] & mask;
+    while (Buckets[i]) i = (i + 1) & mask;
+    Buckets[i] = s + 1;
+  }
+}
+
+static void seedPredefined() {
+  static const char *predefined[] = {
+    "",
+    "void",
+    "boolean",
+    "byte",
+    "integer",
+    "number",
+    "malloc",
+    "length",
+  };
+
+  for (unsigned i = 0, e = sizeof(predefined) / sizeof(predefined[0]); i < e; i++) {
+    unsigned length = strlen(predefined[i]);
+    insertName(predefined[i], length, hashName(predefined[i], length));
+  }
+}
+
+static Symbol insertName(const char *str, unsigned length, unsigned hash) {
+  if (2 * (Names.size() + 1) > Buckets.size())
+    growBuckets();
+
+  unsigned mask = Buckets.size() - 1;
+  unsigned i = hash & mask;
+  while (Buckets[i]) {
+    Symbol candidate = Buckets[i] - 1;
+    if (Hashes[candidate] == hash) {
+      const std::string &name = Names[candidate];
+      if (name.size() == length && 0 == memcmp(name.data(), str, length))
+        return candidate;
+    }
+    i = (i + 1) & mask;
+  }
+
+  Symbol symbol = Names.size();
+  Names.push_back(std::string(str, length));
+  Hashes.push_back(hash);
+  Buckets[i] = symbol + 1;
+
+  return symbol;
+}
+
+Symbol internSymbol(const char *str, unsigned length) {
+  if (Names.empty()) seedPredefined();
+
+  return insertName(str, length, hashName(str, length));
+}
+
+Symbol internSymbol(const std::string &str) {
+  return internSymbol(str.data(), str.size());
+}
+
+const std::string &getSymbolName(Symbol symbol) {
+  if (Names.empty()) seedPredefined();
+
+  return Names[symbol];
+}
+
+unsigned getSymbolCount() {
+  if (Names.empty()) seedPredefined();
+
+  return Names.size();
+}
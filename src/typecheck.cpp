@@ -1,9 +1,10 @@
 // typecheck
 
 #include <cstdio>
-#include <map>
+#include <vector>
 
 #include "ast.h"
+#include "resolve.h"
 
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/TypeBuilder.h"
@@ -22,29 +23,54 @@ FunctionTypeData *ErrorFT(SourceLocation loc, const char *message) {
   return 0;
 }
 
-static std::map<std::string, TypeData *> NamedValueTypes;
+// types of the current function's value slots
+static std::vector<TypeData *> SlotTypes;
 
 void InitializeTypecheck() {
   LLVMContext &Context = getGlobalContext();
 }
 
-TypeData *BooleanExprAST::Typecheck() {
-  return TypeData::getType("boolean");
+TypeData *BooleanExprAST::InferType() {
+  return TypeData::getType(sym_boolean);
 }
 
-TypeData *IntegerExprAST::Typecheck() {
-  return TypeData::getType("integer");
+TypeData *IntegerExprAST::InferType() {
+  return TypeData::getType(sym_integer);
 }
 
-TypeData *NumberExprAST::Typecheck() {
-  return TypeData::getType("number");
+TypeData *NumberExprAST::InferType() {
+  return TypeData::getType(sym_number);
 }
 
-TypeData *VariableExprAST::Typecheck() {
-  TypeData* T = NamedValueTypes[Name];
+TypeData *VariableExprAST::InferType() {
+  if (Binding) {
+    if (!Binding->Type) {
+      std::string message = "Constant has no value: ";
+      message += getSymbolName(Name);
+      return ErrorT(this, message.c_str());
+    }
+    return Binding->Type;
+  }
+
+  if (FunctionRef) {
+    if (FunctionRef->Generic) {
+      std::string message = "Generic function can only be called, not used as a value: ";
+      message += getSymbolName(Name);
+      return ErrorT(this, message.c_str());
+    }
+
+    if (!FunctionRef->Type) {
+      std::string message = "Function has no type: ";
+      message += getSymbolName(Name);
+      return ErrorT(this, message.c_str());
+    }
+    return FunctionRef->Type;
+  }
+
+  TypeData* T = Slot < SlotTypes.size() ? SlotTypes[Slot] : 0;
   if (!T) {
     std::string message = "Unknown variable name: ";
-    message += Name;
+    message += getSymbolName(Name);
     return ErrorT(this, message.c_str());
   }
 
@@ -79,7 +105,7 @@ TypeData *makeCompatible(TypeData *a, TypeData *b) {
 //  }
 }
 
-TypeData *BinaryExprAST::Typecheck() {
+TypeData *BinaryExprAST::InferType() {
   TypeData *L = LHS->Typecheck();
   TypeData *R = RHS->Typecheck();
   if (!L || !R) return 0;
@@ -97,41 +123,82 @@ TypeData *BinaryExprAST::Typecheck() {
   case '>':
   case '=':
   case '&':
-  case '|': return TypeData::getType("boolean");
+  case '|': return TypeData::getType(sym_boolean);
   }
 }
 
-TypeData *CallExprAST::Typecheck() {
-  if (Callee == "integer" || Callee == "number" || Callee == "boolean") {
+TypeData *CallExprAST::InferType() {
+  if (isCast()) {
     if (Args.size() != 1) {
       std::string message = "Cast to ";
-      message += Callee;
+      message += getSymbolName(Callee);
       message += " expects a single parameter";
       return ErrorT(this, message.c_str());
     }
 
     TypeData *argType = Args[0]->Typecheck();
+    if (!argType) return 0;
 
-    std::string typeslug = "(";
-    typeslug += argType->getName();
-    typeslug += ")";
-    typeslug += Callee;
-
-    TypeData *fnType = TypeData::getType(typeslug.c_str());
+    TypeData *fnType = argType->getConverterType(TypeData::getType(Callee));
     if (!fnType) {
-      std::string message = "Unable to find cast for ";
-      message += typeslug;
+      std::string message = "Unable to find cast for (";
+      message += argType->getName();
+      message += ")";
+      message += getSymbolName(Callee);
       return ErrorT(this, message.c_str());
     }
 
     return TypeData::getType(Callee);
   }
 
-  FunctionTypeData* FT = FunctionTypeData::getFunctionType(Callee);
+  if (isLength()) {
+    if (Args.size() != 1)
+      return ErrorT(this, "length expects a single parameter");
+
+    TypeData *argType = Args[0]->Typecheck();
+    if (!argType) return 0;
+
+    if (!argType->isArrayType() && !argType->isSliceType()) {
+      std::string message = "length expects an array or a slice, not ";
+      message += argType->getName();
+      return ErrorT(this, message.c_str());
+    }
+
+    return TypeData::getType(sym_integer);
+  }
+
+  // the instance is compiled right away, in the middle of this function
+  if (Binding && Binding->Generic) {
+    std::vector<TypeData *> argTypes;
+    for (unsigned i = 0, e = Args.size(); i < e; i++) {
+      argTypes.push_back(Args[i]->Typecheck());
+      if (!argTypes.back()) return 0;
+    }
+
+    std::vector<TypeData *> callerSlots;
+    callerSlots.swap(SlotTypes);
+    FunctionBinding *instance = Binding->Generic->Instantiate(argTypes, getLocation());
+    SlotTypes.swap(callerSlots);
+
+    if (!instance) return 0;
+    Binding = instance;
+  }
+
+  FunctionTypeData* FT = Binding ? Binding->Type : 0;
+
+  if (Indirect) {
+    TypeData *T = Slot < SlotTypes.size() ? SlotTypes[Slot] : 0;
+    if (T && !T->isFunctionType()) {
+      std::string message = "Called value isn't a function: ";
+      message += getSymbolName(Callee);
+      return ErrorT(this, message.c_str());
+    }
+    FT = (FunctionTypeData *)T;
+  }
 
   if (!FT) {
     std::string message = "Unknown function reference: ";
-    message += Callee;
+    message += getSymbolName(Callee);
     return ErrorT(this, message.c_str());
   }
 
@@ -146,7 +213,7 @@ TypeData *CallExprAST::Typecheck() {
     TypeData *Coalesced = makeCompatible(paramType, argType);
     if (Coalesced != paramType) {
       std::string message = "Incompatible types in call to ";
-      message += Callee;
+      message += getSymbolName(Callee);
       message += ": param type ";
       message += paramType->getName();
       message += ", arg type ";
@@ -158,7 +225,7 @@ TypeData *CallExprAST::Typecheck() {
   return FT->getReturnType();
 }
 
-TypeData *ArrayLiteralExprAST::Typecheck() {
+TypeData *ArrayLiteralExprAST::InferType() {
   if (Elements.size() == 0) {
     return EmptyArrayTypeData::get();
   }
@@ -184,26 +251,20 @@ TypeData *ArrayLiteralExprAST::Typecheck() {
 
   //fprintf(stderr, "array literal has element type %s\n", elType->getName().c_str());
 
-  std::string arrayTypeName = "[";
-  arrayTypeName += elType->getName();
-  arrayTypeName += "]";
-
-  TypeData *arrayType = TypeData::getType(arrayTypeName);
-
-  if (!arrayType) {
-    arrayType = new ArrayTypeData(elType);
-    TypeData::registerType(arrayType);
-  }
-
-  return arrayType;
+  return ArrayTypeData::get(elType);
 }
 
-TypeData *ArrayReferenceExprAST::Typecheck() {
+TypeData *ArrayReferenceExprAST::InferType() {
   TypeData *indexType = Index->Typecheck();
-  if (indexType != TypeData::getType("integer"))
+  if (indexType != TypeData::getType(sym_integer))
     return ErrorT(this, "array index must be an integer");
 
   TypeData *sourceType = Source->Typecheck();
+  if (!sourceType) return 0;
+
+  if (sourceType->isSliceType())
+    return ((SliceTypeData *)sourceType)->getMemberType();
+
   if (!sourceType->isArrayType())
     return ErrorT(this, "array reference must be an array type");
 
@@ -212,11 +273,39 @@ TypeData *ArrayReferenceExprAST::Typecheck() {
   return at->getMemberType();
 }
 
-TypeData *ValueLiteralAST::Typecheck() {
+TypeData *SliceExprAST::InferType() {
+  TypeData *integerType = TypeData::getType(sym_integer);
+
+  TypeData *startType = Start->Typecheck();
+  if (!startType) return 0;
+
+  TypeData *endType = End->Typecheck();
+  if (!endType) return 0;
+
+  if (startType != integerType || endType != integerType)
+    return ErrorT(this, "slice bounds must be integers");
+
+  TypeData *sourceType = Source->Typecheck();
+  if (!sourceType) return 0;
+
+  if (sourceType->isSliceType())
+    return sourceType;
+
+  if (!sourceType->isArrayType() || ((ArrayTypeData *)sourceType)->isEmptyArray())
+    return ErrorT(this, "only an array or a slice can be sliced");
+
+  return SliceTypeData::get(((ArrayTypeData *)sourceType)->getMemberType());
+}
+
+TypeData *EmbedExprAST::InferType() {
+  return ArrayTypeData::get(TypeData::getType(sym_byte));
+}
+
+TypeData *ValueLiteralAST::InferType() {
   TypeData *valueType = TypeData::getType(ValueType);
   if (!valueType) {
     std::string message = "No type found named ";
-    message += ValueType;
+    message += getSymbolName(ValueType);
     return ErrorT(this, message.c_str());
   }
 
@@ -236,7 +325,7 @@ TypeData *ValueLiteralAST::Typecheck() {
     TypeData *coalesced = makeCompatible(expected, literalType);
     if (coalesced != expected) {
       std::string message = "Incomaptible type in ";
-      message += ValueType;
+      message += getSymbolName(ValueType);
       message += " literal";
       return ErrorT(this, message.c_str());
     }
@@ -247,7 +336,7 @@ TypeData *ValueLiteralAST::Typecheck() {
   return valueType;
 }
 
-TypeData *ValueReferenceAST::Typecheck() {
+TypeData *ValueReferenceAST::InferType() {
   TypeData *ref = Source->Typecheck();
   if (!ref) return 0;
 
@@ -258,18 +347,18 @@ TypeData *ValueReferenceAST::Typecheck() {
 
   StructTypeData *st = (StructTypeData *)ref;
 
-  TypeData *field = st->getFieldType(FieldReference);
+  TypeData *field = st->getFieldTypeByName(FieldReference);
 
   if (!field) {
     std::string message = "Value has no field named ";
-    message += FieldReference;
+    message += getSymbolName(FieldReference);
     return ErrorT(this, message.c_str());
   }
 
   return field;
 }
 
-TypeData *BlockExprAST::Typecheck() {
+TypeData *BlockExprAST::InferType() {
   if (Statements.size() == 0) {
     return ErrorT(this, "Block should have at least one statement");
   }
@@ -282,10 +371,26 @@ TypeData *BlockExprAST::Typecheck() {
   return t;
 }
 
-TypeData *ConditionalExprAST::Typecheck() {
+TypeData *LetExprAST::InferType() {
+  TypeData *valueType = Value->Typecheck();
+  if (!valueType) return 0;
+
+  if (valueType == TypeData::getType(sym_void)) {
+    std::string message = "Can't bind a void value to ";
+    message += getSymbolName(Name);
+    return ErrorT(this, message.c_str());
+  }
+
+  if (SlotTypes.size() <= Slot) SlotTypes.resize(Slot + 1);
+  SlotTypes[Slot] = valueType;
+
+  return TypeData::getType(sym_void);
+}
+
+TypeData *ConditionalExprAST::InferType() {
   TypeData *conditionType = Condition->Typecheck();
   if (!conditionType) return 0;
-  if (conditionType != TypeData::getType("boolean")) {
+  if (conditionType != TypeData::getType(sym_boolean)) {
     return ErrorT(this, "Condition should be boolean type");
   }
 
@@ -303,6 +408,39 @@ TypeData *ConditionalExprAST::Typecheck() {
   return coalesced;
 }
 
+TypeData *WhileExprAST::InferType() {
+  TypeData *conditionType = Condition->Typecheck();
+  if (!conditionType) return 0;
+  if (conditionType != TypeData::getType(sym_boolean)) {
+    return ErrorT(this, "Loop condition should be boolean type");
+  }
+
+  if (!Body->Typecheck()) return 0;
+
+  return TypeData::getType(sym_void);
+}
+
+TypeData *ForExprAST::InferType() {
+  TypeData *integerType = TypeData::getType(sym_integer);
+
+  TypeData *startType = Start->Typecheck();
+  if (!startType) return 0;
+
+  TypeData *endType = End->Typecheck();
+  if (!endType) return 0;
+
+  if (startType != integerType || endType != integerType) {
+    return ErrorT(this, "Loop range should be integer type");
+  }
+
+  if (SlotTypes.size() <= Slot) SlotTypes.resize(Slot + 1);
+  SlotTypes[Slot] = integerType;
+
+  if (!Body->Typecheck()) return 0;
+
+  return TypeData::getType(sym_void);
+}
+
 FunctionTypeData *PrototypeAST::Typecheck() {
   TypeData *ReturnType = TypeData::getType(Returns);
   if (!ReturnType) {
@@ -311,6 +449,9 @@ FunctionTypeData *PrototypeAST::Typecheck() {
     return ErrorFT(Location, message.c_str());
   }
 
+  if (SlotTypes.size() < ArgTypes.size())
+    SlotTypes.resize(ArgTypes.size());
+
   std::vector<TypeData *> Params;
   for (unsigned i = 0, e = ArgTypes.size(); i < e; i++) {
     TypeData *ArgType = TypeData::getType(ArgTypes[i]);
@@ -321,18 +462,40 @@ FunctionTypeData *PrototypeAST::Typecheck() {
     }
 
     Params.push_back(ArgType);
-    NamedValueTypes[ArgNames[i]] = ArgType;
+    SlotTypes[i] = ArgType;
   }
 
-  FunctionTypeData *FT = new FunctionTypeData(ReturnType, Params);
+  FunctionTypeData *FT = FunctionTypeData::get(ReturnType, Params);
 
-  FunctionTypeData::registerFunctionType(Name, FT);
+  // code already compiled against the old type can't follow a change
+  if (Binding->Code && Binding->Type != FT && Name != sym_empty) {
+    std::string message = "Conflicting types for function: ";
+    message += getSymbolName(Name);
+    return ErrorFT(Location, message.c_str());
+  }
+
+  Binding->Type = FT;
 
   return FT;
 }
 
+TypeData *ConstantAST::Typecheck() {
+  TypeData *T = Value->Typecheck();
+  if (!T) return 0;
+
+  if (T == TypeData::getType(sym_void)) {
+    std::string message = "Can't define a constant with a void value: ";
+    message += getSymbolName(Name);
+    TypeError(Location, message.c_str());
+    return 0;
+  }
+
+  Binding->Type = T;
+  return T;
+}
+
 FunctionTypeData *FunctionAST::Typecheck() {
-  NamedValueTypes.clear();
+  SlotTypes.assign(NumSlots, 0);
 
   FunctionTypeData *T = Proto->Typecheck();
   if (!T) return 0;
@@ -342,13 +505,31 @@ FunctionTypeData *FunctionAST::Typecheck() {
 
   TypeData* ReturnType = T->getReturnType();
 
-  if (ReturnType->getName() == "void")
+  // the table is keyed on the bits of each argument
+  if (MemoCapacity) {
+    for (unsigned i = 0, e = T->getNumParameters(); i < e; i++) {
+      TypeData *param = T->getParameterType(i);
+      if (param->isArrayType() || param->isSliceType() || param->isStructType() || param->isFunctionType()) {
+        std::string message = "Memo function arguments must be booleans, bytes, integers or numbers: ";
+        message += getSymbolName(Proto->getName());
+        return ErrorFT(Proto->getLocation(), message.c_str());
+      }
+    }
+
+    if (ReturnType == TypeData::getType(sym_void)) {
+      std::string message = "Memo function must return a value: ";
+      message += getSymbolName(Proto->getName());
+      return ErrorFT(Proto->getLocation(), message.c_str());
+    }
+  }
+
+  if (ReturnType == TypeData::getType(sym_void))
     return T;
 
   TypeData* Coalesced = makeCompatible(ReturnType, BodyType);
   if (!Coalesced) {
     std::string message = "Incompatible types in definition of: ";
-    message += Proto->getName();
+    message += getSymbolName(Proto->getName());
     return ErrorFT(Proto->getLocation(), message.c_str());
   }
 
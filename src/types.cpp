@@ -33,6 +33,13 @@ static std::string arrayTypeName(void *elementType, nameFn getName) {
   return name;
 }
 
+static std::string sliceTypeName(void *elementType, nameFn getName) {
+  std::string name = "[";
+  name += getName(elementType);
+  name += "..]";
+  return name;
+}
+
 // type specifiers
 
 std::string FunctionTypeSpecifier::getName() {
@@ -47,33 +54,179 @@ std::string ArrayTypeSpecifier::getName() {
   return arrayTypeName(elementType, specName);
 }
 
+std::string SliceTypeSpecifier::getName() {
+  return sliceTypeName(elementType, specName);
+}
+
+TypeData *BasicTypeSpecifier::getTypeData() {
+  return TypeData::getType(name);
+}
+
+TypeData *FunctionTypeSpecifier::getTypeData() {
+  TypeData *returns = returnType->getTypeData();
+  if (!returns) return 0;
+
+  std::vector<TypeData *> takes;
+  for (unsigned i = 0, e = parameterTypes.size(); i < e; i++) {
+    takes.push_back(parameterTypes[i]->getTypeData());
+    if (!takes.back()) return 0;
+  }
+
+  return FunctionTypeData::get(returns, takes);
+}
+
+TypeData *ArrayTypeSpecifier::getTypeData() {
+  TypeData *member = elementType->getTypeData();
+  if (!member) return 0;
+
+  return ArrayTypeData::get(member);
+}
+
+TypeData *SliceTypeSpecifier::getTypeData() {
+  TypeData *member = elementType->getTypeData();
+  if (!member) return 0;
+
+  return SliceTypeData::get(member);
+}
+
+// type parameters
+//
+// Matching only binds parameters, whether the actual type fits the rest
+// of the specifier is left to typechecking the instance.
+
+bool BasicTypeSpecifier::Match(TypeData *actual, TypeParameters &params) {
+  TypeParameters::iterator found = params.find(name);
+  if (found == params.end()) return true;
+
+  if (!found->second) found->second = actual;
+  return found->second == actual;
+}
+
+bool FunctionTypeSpecifier::Match(TypeData *actual, TypeParameters &params) {
+  if (!actual->isFunctionType()) return true;
+
+  FunctionTypeData *function = (FunctionTypeData *)actual;
+  if (function->getNumParameters() != parameterTypes.size()) return true;
+
+  for (unsigned i = 0, e = parameterTypes.size(); i < e; i++) {
+    if (!parameterTypes[i]->Match(function->getParameterType(i), params)) return false;
+  }
+  return returnType->Match(function->getReturnType(), params);
+}
+
+bool ArrayTypeSpecifier::Match(TypeData *actual, TypeParameters &params) {
+  if (!actual->isArrayType() || ((ArrayTypeData *)actual)->isEmptyArray()) return true;
+  return elementType->Match(((ArrayTypeData *)actual)->getMemberType(), params);
+}
+
+bool SliceTypeSpecifier::Match(TypeData *actual, TypeParameters &params) {
+  if (!actual->isSliceType()) return true;
+  return elementType->Match(((SliceTypeData *)actual)->getMemberType(), params);
+}
+
+TypeData *BasicTypeSpecifier::Instantiate(const TypeParameters &params) {
+  TypeParameters::const_iterator found = params.find(name);
+  return found == params.end() ? getTypeData() : found->second;
+}
+
+TypeData *FunctionTypeSpecifier::Instantiate(const TypeParameters &params) {
+  TypeData *returns = returnType->Instantiate(params);
+  if (!returns) return 0;
+
+  std::vector<TypeData *> takes;
+  for (unsigned i = 0, e = parameterTypes.size(); i < e; i++) {
+    takes.push_back(parameterTypes[i]->Instantiate(params));
+    if (!takes.back()) return 0;
+  }
+
+  return FunctionTypeData::get(returns, takes);
+}
+
+TypeData *ArrayTypeSpecifier::Instantiate(const TypeParameters &params) {
+  TypeData *member = elementType->Instantiate(params);
+  if (!member) return 0;
+
+  return ArrayTypeData::get(member);
+}
+
+TypeData *SliceTypeSpecifier::Instantiate(const TypeParameters &params) {
+  TypeData *member = elementType->Instantiate(params);
+  if (!member) return 0;
+
+  return SliceTypeData::get(member);
+}
+
 // types
 
 // static methods
 
-std::map<std::string, TypeData *> TypeData::types;
-std::map<std::string, FunctionTypeData *> FunctionTypeData::functionTypes;
+std::unordered_map<Symbol, TypeData *> TypeData::types;
+std::vector<TypeData *> TypeData::typesByID;
+
+// structural types are unique by the IDs of their component types
+
+struct TypeIDListHash {
+  size_t operator()(const std::vector<unsigned> &ids) const {
+    size_t hash = ids.size();
+    for (unsigned i = 0, e = ids.size(); i < e; i++) {
+      hash = hash * 31 + ids[i];
+    }
+    return hash;
+  }
+};
+
+static std::unordered_map<std::vector<unsigned>, FunctionTypeData *, TypeIDListHash> uniqueFunctionTypes;
+static std::unordered_map<unsigned, ArrayTypeData *> uniqueArrayTypes;
+static std::unordered_map<unsigned, SliceTypeData *> uniqueSliceTypes;
+
+FunctionTypeData *FunctionTypeData::get(TypeData *returns, const std::vector<TypeData *> &takes) {
+  std::vector<unsigned> key;
+  key.push_back(returns->getID());
+  for (unsigned i = 0, e = takes.size(); i < e; i++) {
+    key.push_back(takes[i]->getID());
+  }
 
-TypeData *TypeData::getType(std::string name) {
-  TypeSpecifier *t = new BasicTypeSpecifier(name);
-  return getType(t);
+  FunctionTypeData *&unique = uniqueFunctionTypes[key];
+  if (!unique) {
+    unique = new FunctionTypeData(returns, takes);
+    registerType(unique);
+  }
+  return unique;
 }
 
-TypeData *TypeData::getType(TypeSpecifier *specifier) {
-  std::string name = specifier->getName();
-  return TypeData::types[name];
+ArrayTypeData *ArrayTypeData::get(TypeData *memberType) {
+  ArrayTypeData *&unique = uniqueArrayTypes[memberType->getID()];
+  if (!unique) {
+    unique = new ArrayTypeData(memberType);
+    registerType(unique);
+  }
+  return unique;
 }
 
-void TypeData::registerType(TypeData *type) {
-  TypeData::types[type->getName()] = type;
+SliceTypeData *SliceTypeData::get(TypeData *memberType) {
+  SliceTypeData *&unique = uniqueSliceTypes[memberType->getID()];
+  if (!unique) {
+    unique = new SliceTypeData(ArrayTypeData::get(memberType));
+    registerType(unique);
+  }
+  return unique;
+}
+
+TypeData *TypeData::getType(Symbol name) {
+  std::unordered_map<Symbol, TypeData *>::iterator found = TypeData::types.find(name);
+  return found == TypeData::types.end() ? 0 : found->second;
 }
 
-FunctionTypeData *FunctionTypeData::getFunctionType(std::string name) {
-  return FunctionTypeData::functionTypes[name];
+TypeData *TypeData::getType(const std::string &name) {
+  return getType(internSymbol(name));
 }
 
-void FunctionTypeData::registerFunctionType(std::string name, FunctionTypeData *type) {
-  FunctionTypeData::functionTypes[name] = type;
+TypeData *TypeData::getType(TypeSpecifier *specifier) {
+  return specifier->getTypeData();
+}
+
+void TypeData::registerType(TypeData *type) {
+  TypeData::types[internSymbol(type->getName())] = type;
 }
 
 // basic type methods
@@ -98,26 +251,28 @@ TypeData *BasicTypeData::getConverterType(TypeData *other) {
 
   std::vector<TypeData *> ps;
   ps.push_back(this);
-  return new FunctionTypeData(other, ps);
+  return FunctionTypeData::get(other, ps);
 }
 
 // function type methods
 
 std::string FunctionTypeData::getName() {
-  std::string name = "(";
-  if (parameterTypes.size() > 0) {
-    name += parameterTypes[0]->getName();
+  // already named
+  if (!name.empty()) return name;
 
-    for (unsigned i = 1, e = parameterTypes.size(); i < e; i++) {
-      name += "," + parameterTypes[i]->getName();
-    }
+  std::vector<void *> pts;
+  for (unsigned i = 0, e = parameterTypes.size(); i < e; i++) {
+    pts.push_back(parameterTypes[i]);
   }
-  name += ")" + returnType->getName();
+  name = functionTypeName(pts, returnType, dataName);
 
   return name;
 }
 
-llvm::Type *FunctionTypeData::getLLVMType() {
+llvm::FunctionType *FunctionTypeData::getFunctionType() {
+  // already made one
+  if (functionType) return functionType;
+
   llvm::Type *returns = returnType->getLLVMType();
 
   std::vector<llvm::Type *> takes;
@@ -125,10 +280,27 @@ llvm::Type *FunctionTypeData::getLLVMType() {
     takes.push_back(parameterTypes[i]->getLLVMType());
   }
 
-  return llvm::FunctionType::get(returns, takes, false);
+  functionType = llvm::FunctionType::get(returns, takes, false);
+  return functionType;
 }
 
 llvm::DIType FunctionTypeData::getDIType(DebugContext *context) {
+  if (hasPointerDIType) {
+    return pointerDIType;
+  }
+
+  uint64_t size = context->getDataLayout()->getPointerSizeInBits();
+  pointerDIType = context->getBuilder()->createPointerType(getSubroutineDIType(context), size, size);
+  hasPointerDIType = true;
+
+  return pointerDIType;
+}
+
+llvm::DIType FunctionTypeData::getSubroutineDIType(DebugContext *context) {
+  if (hasDIType) {
+    return diType;
+  }
+
   llvm::SmallVector<llvm::Value *, 8> paramTypes;
 
   paramTypes.push_back(returnType->getDIType(context));
@@ -137,7 +309,10 @@ llvm::DIType FunctionTypeData::getDIType(DebugContext *context) {
   }
 
   llvm::DIArray paramTypeArray = context->getBuilder()->getOrCreateArray(paramTypes);
-  return context->getBuilder()->createSubroutineType(context->getFile(), paramTypeArray);
+  diType = context->getBuilder()->createSubroutineType(context->getFile(), paramTypeArray);
+  hasDIType = true;
+
+  return diType;
 }
 
 // struct type methods
@@ -151,7 +326,6 @@ llvm::Type *StructTypeData::getLLVMType() {
   //fprintf(stdout, "getting llvm type for %s\n", name.c_str());
 
   for (unsigned i = 0, e = fieldTypes.size(); i < e; i++) {
-    std::string field = fieldNames[i];
     TypeData *fieldType = fieldTypes[i];
     if (!fieldType) return 0;
 
@@ -170,7 +344,7 @@ llvm::DIType StructTypeData::getDIType(DebugContext *context) {
 
   llvm::SmallVector<llvm::Value *, 8> fields;
   for (unsigned i = 0, e = fieldTypes.size(); i < e; i++) {
-    std::string fieldName = fieldNames[i];
+    const std::string &fieldName = getSymbolName(fieldNames[i]);
     TypeData *fieldType = fieldTypes[i];
     if (!fieldType) return llvm::DIType();
 
@@ -203,16 +377,16 @@ llvm::DIType StructTypeData::getDIType(DebugContext *context) {
 // array type
 
 std::string ArrayTypeData::getName() {
-  std::string name = "[";
-  name += MemberType->getName();
-  name += "]";
-  return name;
+  return arrayTypeName(MemberType, dataName);
 }
 
 llvm::Type *ArrayTypeData::getLLVMType() {
+  // already made one
+  if (LLVMType) return LLVMType;
+
   llvm::SmallVector<llvm::Type *, 8> fTypes;
 
-  TypeData *integerType = TypeData::getType("integer");
+  TypeData *integerType = TypeData::getType(sym_integer);
   fTypes.push_back(integerType->getLLVMType());
 
   llvm::Type *elType = MemberType->getLLVMType();
@@ -220,38 +394,100 @@ llvm::Type *ArrayTypeData::getLLVMType() {
 
   llvm::Type *dataStruct = llvm::StructType::get(llvm::getGlobalContext(), fTypes);
 
-  return llvm::PointerType::get(dataStruct, 0);
+  LLVMType = llvm::PointerType::get(dataStruct, 0);
+  return LLVMType;
 }
 
 llvm::DIType ArrayTypeData::getDIType(DebugContext *context) {
-  return context->getBuilder()->createBasicType("integer", 64, 64, llvm::dwarf::DW_ATE_signed);
+  if (HasDebugType) {
+    return DebugType;
+  }
+
+  DebugType = context->getBuilder()->createBasicType("integer", 64, 64, llvm::dwarf::DW_ATE_signed);
+  HasDebugType = true;
+
+  return DebugType;
+}
+
+// slice type
+
+std::string SliceTypeData::getName() {
+  return sliceTypeName(getMemberType(), dataName);
+}
+
+llvm::Type *SliceTypeData::getLLVMType() {
+  // already made one
+  if (LLVMType) return LLVMType;
+
+  llvm::Type *integerType = TypeData::getType(sym_integer)->getLLVMType();
+
+  llvm::SmallVector<llvm::Type *, 8> fTypes;
+  fTypes.push_back(ArrayType->getLLVMType());
+  fTypes.push_back(integerType);
+  fTypes.push_back(integerType);
+
+  LLVMType = llvm::StructType::get(llvm::getGlobalContext(), fTypes);
+  return LLVMType;
+}
+
+llvm::DIType SliceTypeData::getDIType(DebugContext *context) {
+  if (HasDebugType) {
+    return DebugType;
+  }
+
+  static const char *fieldNames[] = { "array", "offset", "length" };
+
+  llvm::StructType *llvmType = (llvm::StructType *)getLLVMType();
+  const llvm::StructLayout *layout = context->getDataLayout()->getStructLayout(llvmType);
+
+  llvm::SmallVector<llvm::Value *, 8> fields;
+  for (unsigned i = 0; i < 3; i++) {
+    llvm::Type *fieldLLVMType = llvmType->getElementType(i);
+
+    uint64_t elsize = context->getDataLayout()->getTypeSizeInBits(fieldLLVMType);
+    uint64_t elalign = context->getDataLayout()->getABITypeAlignment(fieldLLVMType);
+    uint64_t eloffset = layout->getElementOffsetInBits(i);
+    llvm::DIType t = i == 0 ? ArrayType->getDIType(context) : TypeData::getType(sym_integer)->getDIType(context);
+
+    fields.push_back(context->getBuilder()->createMemberType(llvm::DIDescriptor(), fieldNames[i], context->getFile(), 0, elsize, elalign, eloffset, llvm::dwarf::DW_ACCESS_public, t));
+  }
+
+  uint64_t size = context->getDataLayout()->getTypeSizeInBits(llvmType);
+  uint64_t align = context->getDataLayout()->getABITypeAlignment(llvmType);
+
+  llvm::DIArray elements = context->getBuilder()->getOrCreateArray(fields);
+
+  DebugType = context->getBuilder()->createStructType(llvm::DIDescriptor(), getName(), context->getFile(), 0, size, align, 0, llvm::DIType(), elements);
+  HasDebugType = true;
+
+  return DebugType;
 }
 
 // basic types
 
 llvm::Value *convertBooleanToInteger(llvm::IRBuilder<> irBuilder, llvm::Value *value) {
-  return irBuilder.CreateZExt(value, TypeData::getType("integer")->getLLVMType(), "casttmp");
+  return irBuilder.CreateZExt(value, TypeData::getType(sym_integer)->getLLVMType(), "casttmp");
 }
 
 llvm::Value *convertBooleanToNumber(llvm::IRBuilder<> irBuilder, llvm::Value *value) {
-  return irBuilder.CreateUIToFP(value, TypeData::getType("number")->getLLVMType(), "casttmp");
+  return irBuilder.CreateUIToFP(value, TypeData::getType(sym_number)->getLLVMType(), "casttmp");
 }
 
 llvm::Value *convertIntegerToBoolean(llvm::IRBuilder<> irBuilder, llvm::Value *value) {
-  return irBuilder.CreateTrunc(value, TypeData::getType("boolean")->getLLVMType(), "casttmp");
+  return irBuilder.CreateTrunc(value, TypeData::getType(sym_boolean)->getLLVMType(), "casttmp");
 }
 
 llvm::Value *convertIntegerToNumber(llvm::IRBuilder<> irBuilder, llvm::Value *value) {
-  return irBuilder.CreateSIToFP(value, TypeData::getType("number")->getLLVMType(), "casttmp");
+  return irBuilder.CreateSIToFP(value, TypeData::getType(sym_number)->getLLVMType(), "casttmp");
 }
 
 llvm::Value *convertNumberToBoolean(llvm::IRBuilder<> irBuilder, llvm::Value *value) {
-  llvm::Value *zero = llvm::ConstantFP::get(TypeData::getType("number")->getLLVMType(), 0);
+  llvm::Value *zero = llvm::ConstantFP::get(TypeData::getType(sym_number)->getLLVMType(), 0);
   return irBuilder.CreateFCmpUNE(value, zero, "casttmp");
 }
 
 llvm::Value *convertNumberToInteger(llvm::IRBuilder<> irBuilder, llvm::Value *value) {
-  return irBuilder.CreateFPToSI(value, TypeData::getType("integer")->getLLVMType(), "casttmp");
+  return irBuilder.CreateFPToSI(value, TypeData::getType(sym_integer)->getLLVMType(), "casttmp");
 }
 
 void InitializeBasicTypes(llvm::LLVMContext &context, llvm::DIBuilder *builder) {
@@ -299,21 +535,4 @@ void InitializeBasicTypes(llvm::LLVMContext &context, llvm::DIBuilder *builder)
   TypeData::registerType(integerType);
   TypeData::registerType(numberType);
 
-  TypeData::registerType(booleanType->getConverterType(integerType));
-  TypeData::registerType(booleanType->getConverterType(numberType));
-  TypeData::registerType(integerType->getConverterType(booleanType));
-  TypeData::registerType(integerType->getConverterType(numberType));
-  TypeData::registerType(numberType->getConverterType(booleanType));
-  TypeData::registerType(numberType->getConverterType(integerType));
-
-  ArrayTypeData *booleanArrayType = new ArrayTypeData(booleanType);
-  ArrayTypeData *byteArrayType = new ArrayTypeData(byteType);
-  ArrayTypeData *integerArrayType = new ArrayTypeData(integerType);
-  ArrayTypeData *numberArrayType = new ArrayTypeData(numberType);
-
-  TypeData::registerType(booleanArrayType);
-  TypeData::registerType(byteArrayType);
-  TypeData::registerType(integerArrayType);
-  TypeData::registerType(numberArrayType);
-
 }